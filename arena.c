@@ -0,0 +1,63 @@
+#include "arena.h"
+#include "common.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_CHUNK (1 << 20)
+
+char *arena_alloc(Arena *a, size_t len, size_t *ref) {
+  if (a->nchunks == 0 || a->used + len > a->chunksize) {
+    if (a->nchunks == a->capacity) {
+      int capacity = a->capacity ? a->capacity * 2 : 16;
+      char **chunks = realloc(a->chunks, sizeof(char *) * capacity);
+      size_t *sizes = realloc(a->sizes, sizeof(size_t) * capacity);
+      if (chunks == NULL || sizes == NULL) {
+        die("realloc");
+      }
+      a->chunks = chunks;
+      a->sizes = sizes;
+      a->capacity = capacity;
+    }
+
+    // Lines longer than a chunk get a chunk of their own.
+    size_t chunksize = len > ARENA_CHUNK ? len : ARENA_CHUNK;
+    char *chunk = malloc(chunksize);
+    if (chunk == NULL) {
+      die("malloc");
+    }
+    a->chunks[a->nchunks] = chunk;
+    a->sizes[a->nchunks++] = chunksize;
+    a->chunksize = chunksize;
+    a->bytes += chunksize;
+    a->used = 0;
+  }
+
+  char *p = &a->chunks[a->nchunks - 1][a->used];
+  *ref = ((size_t)(a->first + a->nchunks - 1) << 32) | a->used;
+  a->used += len;
+  return p;
+}
+
+char *arena_at(Arena *a, size_t ref) {
+  return &a->chunks[(ref >> 32) - a->first][ref & 0xffffffff];
+}
+
+// Frees the oldest chunk. Rows pointing into it must be dropped first.
+void arena_evict(Arena *a) {
+  if (a->nchunks <= 1)
+    return;
+  free(a->chunks[0]);
+  a->bytes -= a->sizes[0];
+  a->nchunks--;
+  memmove(a->chunks, &a->chunks[1], sizeof(char *) * a->nchunks);
+  memmove(a->sizes, &a->sizes[1], sizeof(size_t) * a->nchunks);
+  a->first++;
+}
+
+void arena_free(Arena *a) {
+  for (int i = 0; i < a->nchunks; i++)
+    free(a->chunks[i]);
+  free(a->chunks);
+  free(a->sizes);
+  *a = (Arena){0};
+}
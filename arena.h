@@ -0,0 +1,27 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+
+// Chunked bump allocator for row bytes. Chunks never move once allocated,
+// and an allocation is identified by a reference that packs the chunk number
+// into the upper 32 bits and the offset within the chunk into the lower 32.
+// The oldest chunks can be evicted; chunks[0] is chunk number first.
+typedef struct {
+  char **chunks;
+  size_t *sizes;
+  int nchunks;
+  int capacity;
+  int first;
+  size_t used;
+  size_t chunksize;
+  // Bytes in all chunks.
+  size_t bytes;
+} Arena;
+
+char *arena_alloc(Arena *a, size_t len, size_t *ref);
+char *arena_at(Arena *a, size_t ref);
+void arena_evict(Arena *a);
+void arena_free(Arena *a);
+
+#endif // ARENA_H_
@@ -0,0 +1,116 @@
+#define _DEFAULT_SOURCE
+
+// Compares the matcher engines on every line of a log file, the way a
+// search runs them:
+//
+//   make match_bench && ./match_bench big.log [pattern...]
+
+#include "../matcher.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+// Typical things to look for in a log: words, levels, ids, alternatives
+// and patterns with a lot of '.*'. The last one has matches that could be
+// extended to the end of the row, which is slow on long rows unless they
+// are cut short where they end.
+static const char *default_patterns[] = {
+    "timeout",
+    "ERROR\\|WARN",
+    "svc\\[1[0-9]\\]",
+    "upstream.*reset",
+    "[0-9]\\{2\\}:[0-9]\\{2\\}:[0-9]\\{2\\}\\.9[0-9]*",
+    "^2024-05-01 14:0[0-5]",
+    ".*cache.*login.*hit",
+    "\\(hit \\)\\{3\\}",
+    "a\\|a.*z",
+};
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(const char *engine, const char *pattern, const char *data,
+                  size_t size) {
+  Matcher m;
+  if (!matcher_compile(&m, pattern, engine)) {
+    printf("%-40s %-6s does not compile\n", pattern, engine);
+    return;
+  }
+  if (strcmp(m.engine->name, engine) != 0) {
+    printf("%-40s %-6s unsupported\n", pattern, engine);
+    matcher_free(&m);
+    return;
+  }
+
+  double start = now();
+  size_t matches = 0;
+  const char *line = data;
+  const char *end = data + size;
+  while (line < end) {
+    const char *nl = memchr(line, '\n', end - line);
+    regoff_t len = nl ? nl - line : end - line;
+    regoff_t off = 0;
+    regmatch_t match;
+    while (off <= len && matcher_exec(&m, line, len, off, &match)) {
+      matches++;
+      off = match.rm_eo > match.rm_so ? match.rm_eo : match.rm_eo + 1;
+    }
+    line += len + 1;
+  }
+  double secs = now() - start;
+
+  printf("%-40s %-6s %10zu matches %8.3f s %8.1f MB/s\n", pattern, engine,
+         matches, secs, size / secs / 1e6);
+  matcher_free(&m);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <file> [pattern...]\n", argv[0]);
+    return 1;
+  }
+
+  int fd = open(argv[1], O_RDONLY);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1) {
+    perror(argv[1]);
+    return 1;
+  }
+  char *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  // Fault the file into the page cache so every run measures the same thing.
+  volatile char sink = 0;
+  for (off_t i = 0; i < st.st_size; i += 4096)
+    sink ^= data[i];
+
+  const char **patterns = default_patterns;
+  int npatterns = ARRAY_SIZE(default_patterns);
+  if (argc > 2) {
+    patterns = (const char **)&argv[2];
+    npatterns = argc - 2;
+  }
+
+  printf("%s: %.2f GB\n", argv[1], st.st_size / 1e9);
+  for (int i = 0; i < npatterns; i++) {
+    bench("dfa", patterns[i], data, st.st_size);
+    bench("posix", patterns[i], data, st.st_size);
+  }
+
+  munmap(data, st.st_size);
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,113 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+// Compares the getline loop used for unmappable input against the newline
+// scanners on a mapped file:
+//
+//   make scan_bench && ./scan_bench big.log
+
+#include "../scan.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, size_t lines, size_t bytes, double secs) {
+  printf("%-8s %10zu lines %8.3f s %8.2f GB/s\n", name, lines, secs,
+         bytes / secs / 1e9);
+}
+
+static void bench_getline(const char *path, size_t size) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    perror("fopen");
+    exit(1);
+  }
+
+  double start = now();
+  char *line = NULL;
+  size_t capacity = 0;
+  ssize_t length;
+  size_t lines = 0;
+  size_t total = 0;
+  while ((length = getline(&line, &capacity, fp)) != -1) {
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+      length--;
+    total += length;
+    lines++;
+  }
+  double secs = now() - start;
+  free(line);
+  fclose(fp);
+
+  report("getline", lines, size, secs);
+  if (total == 0)
+    printf("(empty)\n");
+}
+
+static void bench_scan(const char *name, scan_fn scan, const char *data,
+                       size_t size) {
+  static size_t nl[4096];
+
+  double start = now();
+  size_t lines = 0;
+  size_t pos = 0;
+  while (pos < size) {
+    size_t n = scan(data, pos, size, nl, ARRAY_SIZE(nl));
+    lines += n;
+    if (n < ARRAY_SIZE(nl))
+      break;
+    pos = nl[n - 1] + 1;
+  }
+  double secs = now() - start;
+
+  report(name, lines, size, secs);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <file>\n", argv[0]);
+    return 1;
+  }
+
+  int fd = open(argv[1], O_RDONLY);
+  struct stat st;
+  if (fd == -1 || fstat(fd, &st) == -1) {
+    perror(argv[1]);
+    return 1;
+  }
+  char *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  // Fault the file into the page cache so every run measures the same thing.
+  volatile char sink = 0;
+  for (off_t i = 0; i < st.st_size; i += 4096)
+    sink ^= data[i];
+
+  scan_init();
+  printf("%s: %.2f GB, dispatch picks %s\n", argv[1], st.st_size / 1e9,
+         scan_name());
+
+  bench_getline(argv[1], st.st_size);
+  bench_scan("scalar", scan_newlines_scalar, data, st.st_size);
+  bench_scan("sse2", scan_newlines_sse2, data, st.st_size);
+  bench_scan("avx2", scan_newlines_avx2, data, st.st_size);
+
+  munmap(data, st.st_size);
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,235 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include "cache.h"
+#include "loggy.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Files smaller than this index faster than the cache could be checked.
+#define CACHE_MIN (16 << 20)
+// Bytes at the end of the indexed data that must be unchanged for the cache
+// to be trusted.
+#define CACHE_TAIL 4096
+#define CACHE_VERSION 2
+
+// The cache file is this header followed by the rows, exactly as they are
+// laid out in memory, so that they can be used straight from the mapping.
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t rowsize;
+  uint64_t dev;
+  uint64_t ino;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t size;
+  uint64_t tail;
+  uint64_t nrows;
+  int64_t ncols;
+} CacheHeader;
+
+static uint64_t fnv1a(const char *s, size_t len, uint64_t h) {
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static uint64_t tail_hash(Loggy *l, size_t size) {
+  size_t from = size > CACHE_TAIL ? size - CACHE_TAIL : 0;
+  return fnv1a(&l->data[from], size - from, 14695981039346656037ULL);
+}
+
+// Whether the rows follow one another within the first size bytes, so that
+// none reads past the mapping, whatever the cache file holds.
+static bool rows_valid(const Row *rows, uint64_t nrows, uint64_t size) {
+  uint64_t end = 0;
+  for (uint64_t i = 0; i < nrows; i++) {
+    const Row *r = &rows[i];
+    if (r->off < end || r->off > size || r->len < 0 ||
+        (uint64_t)r->len > size - r->off)
+      return false;
+    end = r->off + r->len;
+  }
+  return true;
+}
+
+// The cache lives in $XDG_CACHE_HOME/loggy, or ~/.cache/loggy, named after a
+// hash of the log's absolute path. Returns false if there is nowhere to put
+// it; with create set, missing directories are made.
+static bool cache_path(Loggy *l, char *path, size_t size, bool create) {
+  char *real = realpath(l->filename, NULL);
+  if (real == NULL)
+    return false;
+  uint64_t h = fnv1a(real, strlen(real), 14695981039346656037ULL);
+  free(real);
+
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  int len;
+  if (xdg && *xdg) {
+    len = snprintf(path, size, "%s", xdg);
+  } else if (home && *home) {
+    len = snprintf(path, size, "%s/.cache", home);
+  } else {
+    return false;
+  }
+  if (create)
+    mkdir(path, 0700);
+  len += snprintf(&path[len], size - len, "/loggy");
+  if (create)
+    mkdir(path, 0700);
+  len += snprintf(&path[len], size - len, "/%016llx.idx", (unsigned long long)h);
+  return len < (int)size;
+}
+
+// Takes the rows of the just-mapped file from the cache if it still
+// describes it. The file may have grown since; from is set to where indexing
+// has to carry on.
+bool cache_load(Loggy *l, const struct stat *st, size_t *from) {
+  IndexCache *c = &l->cache;
+  *c = (IndexCache){.dev = st->st_dev, .ino = st->st_ino, .mtime = st->st_mtim};
+  *from = 0;
+  if (l->size < CACHE_MIN)
+    return false;
+
+  char path[PATH_MAX];
+  if (!cache_path(l, path, sizeof(path), false))
+    return false;
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return false;
+  struct stat cst;
+  if (fstat(fd, &cst) == -1 || (size_t)cst.st_size < sizeof(CacheHeader)) {
+    close(fd);
+    return false;
+  }
+  // Private and writable: follow mode rewrites the last row in place.
+  char *map = mmap(NULL, cst.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                   0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return false;
+
+  CacheHeader *h = (CacheHeader *)map;
+  bool valid = memcmp(h->magic, "LOGGYIDX", 8) == 0 &&
+               h->version == CACHE_VERSION && h->rowsize == sizeof(Row) &&
+               h->nrows > 0 && h->nrows <= INT_MAX &&
+               (size_t)cst.st_size ==
+                   sizeof(CacheHeader) + h->nrows * sizeof(Row) &&
+               h->dev == (uint64_t)st->st_dev &&
+               h->ino == (uint64_t)st->st_ino && h->size <= l->size;
+  // The same size with a new mtime means the file was rewritten in place.
+  if (valid && h->size == l->size)
+    valid = h->mtime_sec == st->st_mtim.tv_sec &&
+            h->mtime_nsec == st->st_mtim.tv_nsec;
+  if (valid)
+    valid = h->tail == tail_hash(l, h->size) &&
+            rows_valid((Row *)(map + sizeof(CacheHeader)), h->nrows, h->size);
+  if (!valid) {
+    munmap(map, cst.st_size);
+    return false;
+  }
+
+  c->map = map;
+  c->mapsize = cst.st_size;
+  l->rows = (Row *)(map + sizeof(CacheHeader));
+  l->nrows = h->nrows;
+  l->rowcap = h->nrows;
+  l->ncols = h->ncols;
+  *from = h->size;
+
+  // A last row without a newline may continue in the bytes appended since.
+  if (h->size < l->size && l->data[h->size - 1] != '\n') {
+    l->nrows--;
+    *from = l->rows[l->nrows].off;
+  }
+  c->nrows = l->nrows;
+  return true;
+}
+
+static bool write_all(int fd, const void *buf, size_t len, off_t off) {
+  const char *p = buf;
+  while (len > 0) {
+    ssize_t n = pwrite(fd, p, len, off);
+    if (n <= 0)
+      return false;
+    p += n;
+    len -= n;
+    off += n;
+  }
+  return true;
+}
+
+// Writes the row index of the mapped file to the cache. Rows that came from
+// the cache are already there, so only the ones indexed since are appended.
+void cache_save(Loggy *l) {
+  IndexCache *c = &l->cache;
+  if (!l->mapped || l->size < CACHE_MIN || l->nrows == 0)
+    return;
+
+  char path[PATH_MAX];
+  if (!cache_path(l, path, sizeof(path), true))
+    return;
+
+  CacheHeader h = {.version = CACHE_VERSION,
+                   .rowsize = sizeof(Row),
+                   .dev = c->dev,
+                   .ino = c->ino,
+                   .mtime_sec = c->mtime.tv_sec,
+                   .mtime_nsec = c->mtime.tv_nsec,
+                   .size = l->size,
+                   .tail = tail_hash(l, l->size),
+                   .nrows = l->nrows,
+                   .ncols = l->ncols};
+  memcpy(h.magic, "LOGGYIDX", 8);
+
+  int fd;
+  char tmp[PATH_MAX + 8];
+  if (c->nrows > 0) {
+    fd = open(path, O_WRONLY);
+  } else {
+    // Written aside and renamed, so a reader never sees half a cache.
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+  }
+  if (fd == -1)
+    return;
+
+  off_t end = sizeof(CacheHeader) + (off_t)l->nrows * sizeof(Row);
+  bool ok = write_all(fd, &l->rows[c->nrows],
+                      sizeof(Row) * (l->nrows - c->nrows),
+                      sizeof(CacheHeader) + (off_t)c->nrows * sizeof(Row)) &&
+            ftruncate(fd, end) == 0 &&
+            write_all(fd, &h, sizeof(h), 0);
+  close(fd);
+
+  if (c->nrows == 0) {
+    if (!ok || rename(tmp, path) == -1) {
+      unlink(tmp);
+      return;
+    }
+  }
+  if (ok)
+    c->nrows = l->nrows;
+}
+
+// Releases the cache mapping. The caller must have moved the rows out of it
+// first, or be done with them.
+void cache_unmap(Loggy *l) {
+  IndexCache *c = &l->cache;
+  if (c->map == NULL)
+    return;
+  munmap(c->map, c->mapsize);
+  c->map = NULL;
+  c->mapsize = 0;
+}
@@ -0,0 +1,11 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include "loggy.h"
+#include <sys/stat.h>
+
+bool cache_load(Loggy *l, const struct stat *st, size_t *from);
+void cache_save(Loggy *l);
+void cache_unmap(Loggy *l);
+
+#endif // CACHE_H_
@@ -0,0 +1,1106 @@
+#define _GNU_SOURCE
+
+#include "common.h"
+#include "matcher.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A matcher that never backtracks. The pattern is parsed into a tree and
+// compiled into Thompson NFAs, forward and reversed, which are run as DFAs
+// built lazily: a DFA state is a set of NFA states, made the first time a
+// transition leads to it and cached together with its transitions. Once the
+// states a row needs exist, every byte costs one table lookup.
+//
+// A forward pass tells whether a row matches and a backward one where its
+// matches start. Extending each match to its end could read on to the end
+// of the row every time, so when that starts to add up, another backward
+// pass finds where a match can still be completed and matches stop where
+// they end. The time spent on a row stays linear in its length whatever the
+// pattern, unless the row needs more DFA states than are cached.
+//
+// Patterns using back-references, word boundaries or anything else not
+// handled here fail to compile and are left to the POSIX engine.
+
+// Patterns whose NFA would be larger than this are left to POSIX too.
+#define NFA_MAX 16384
+// DFA states kept before the cache is thrown away and built up again.
+#define DFA_MAX 4096
+// Bounds of \{m,n\} and nesting of \( \) handled here.
+#define REPEAT_MAX 255
+#define DEPTH_MAX 256
+
+typedef uint32_t ByteSet[8];
+
+static bool set_has(const uint32_t *set, unsigned c) {
+  return set[c >> 5] >> (c & 31) & 1;
+}
+
+static void set_add(uint32_t *set, unsigned c) {
+  set[c >> 5] |= 1u << (c & 31);
+}
+
+enum { T_SET, T_CAT, T_ALT, T_REPEAT, T_BOL, T_EOL, T_EMPTY };
+
+// A node of the parsed pattern. max < 0 repeats without bound.
+typedef struct {
+  int type;
+  int a, b;
+  int min, max;
+  int set;
+} Tree;
+
+typedef struct {
+  const char *p;
+  Tree *tree;
+  int ntree, treecap;
+  ByteSet *sets;
+  int nsets, setcap;
+  int depth;
+  bool error;
+} Parser;
+
+static int tree_add(Parser *ps, Tree t) {
+  if (ps->ntree == ps->treecap) {
+    ps->treecap = ps->treecap ? ps->treecap * 2 : 32;
+    ps->tree = realloc(ps->tree, sizeof(Tree) * ps->treecap);
+    if (ps->tree == NULL) {
+      die("realloc");
+    }
+  }
+  ps->tree[ps->ntree] = t;
+  return ps->ntree++;
+}
+
+static int set_new(Parser *ps) {
+  if (ps->nsets == ps->setcap) {
+    ps->setcap = ps->setcap ? ps->setcap * 2 : 8;
+    ps->sets = realloc(ps->sets, sizeof(ByteSet) * ps->setcap);
+    if (ps->sets == NULL) {
+      die("realloc");
+    }
+  }
+  memset(ps->sets[ps->nsets], 0, sizeof(ByteSet));
+  return ps->nsets++;
+}
+
+static int literal(Parser *ps, unsigned char c) {
+  int set = set_new(ps);
+  set_add(ps->sets[set], c);
+  return tree_add(ps, (Tree){.type = T_SET, .set = set});
+}
+
+// Adds the bytes of a character class like "alpha" to set.
+static bool add_class(uint32_t *set, const char *name, size_t len) {
+  static const struct {
+    const char *name;
+    int (*is)(int);
+  } classes[] = {
+      {"alpha", isalpha}, {"digit", isdigit}, {"alnum", isalnum},
+      {"upper", isupper}, {"lower", islower}, {"space", isspace},
+      {"blank", isblank}, {"punct", ispunct}, {"print", isprint},
+      {"graph", isgraph}, {"cntrl", iscntrl}, {"xdigit", isxdigit},
+  };
+  for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+    if (strlen(classes[i].name) == len &&
+        memcmp(classes[i].name, name, len) == 0) {
+      for (int c = 0; c < 256; c++) {
+        if (classes[i].is(c))
+          set_add(set, c);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+// Reads one member of a bracket expression that can end a range: a byte or
+// a collating element like "[.-.]". Returns -1 on error.
+static int bracket_char(Parser *ps) {
+  if (ps->p[0] == '[' && (ps->p[1] == '.' || ps->p[1] == '=')) {
+    char kind = ps->p[1];
+    if (ps->p[2] == '\0' || ps->p[3] != kind || ps->p[4] != ']')
+      return -1;
+    unsigned char c = ps->p[2];
+    ps->p += 5;
+    return c;
+  }
+  if (*ps->p == '\0')
+    return -1;
+  return (unsigned char)*ps->p++;
+}
+
+// Parses a bracket expression; the '[' has been read.
+static int parse_bracket(Parser *ps) {
+  int set = set_new(ps);
+  bool negate = false;
+  if (*ps->p == '^') {
+    negate = true;
+    ps->p++;
+  }
+
+  for (bool first = true; first || *ps->p != ']'; first = false) {
+    if (ps->p[0] == '[' && ps->p[1] == ':') {
+      const char *name = ps->p + 2;
+      const char *end = strstr(name, ":]");
+      if (end == NULL || !add_class(ps->sets[set], name, end - name)) {
+        ps->error = true;
+        return 0;
+      }
+      ps->p = end + 2;
+      continue;
+    }
+
+    int lo = bracket_char(ps);
+    int hi = lo;
+    if (lo >= 0 && ps->p[0] == '-' && ps->p[1] != ']' && ps->p[1] != '\0') {
+      ps->p++;
+      hi = bracket_char(ps);
+    }
+    if (lo < 0 || hi < lo) {
+      ps->error = true;
+      return 0;
+    }
+    for (int c = lo; c <= hi; c++)
+      set_add(ps->sets[set], c);
+  }
+  ps->p++;
+
+  if (negate) {
+    for (int i = 0; i < 8; i++)
+      ps->sets[set][i] = ~ps->sets[set][i];
+  }
+  return tree_add(ps, (Tree){.type = T_SET, .set = set});
+}
+
+static int parse_alt(Parser *ps);
+
+static int parse_atom(Parser *ps) {
+  unsigned char c = *ps->p++;
+  switch (c) {
+  case '.': {
+    int set = set_new(ps);
+    for (int i = 1; i < 256; i++)
+      set_add(ps->sets[set], i);
+    return tree_add(ps, (Tree){.type = T_SET, .set = set});
+  }
+  case '[':
+    return parse_bracket(ps);
+  case '\\':
+    break;
+  default:
+    // Including a '*' that starts an expression, which is literal.
+    return literal(ps, c);
+  }
+
+  c = *ps->p++;
+  switch (c) {
+  case '(': {
+    if (++ps->depth > DEPTH_MAX) {
+      ps->error = true;
+      return 0;
+    }
+    int t = parse_alt(ps);
+    if (ps->p[0] != '\\' || ps->p[1] != ')') {
+      ps->error = true;
+      return 0;
+    }
+    ps->p += 2;
+    ps->depth--;
+    return t;
+  }
+  case 'w':
+  case 'W':
+  case 's':
+  case 'S': {
+    int set = set_new(ps);
+    if (c == 'w' || c == 'W') {
+      add_class(ps->sets[set], "alnum", 5);
+      set_add(ps->sets[set], '_');
+    } else {
+      add_class(ps->sets[set], "space", 5);
+    }
+    if (isupper(c)) {
+      for (int i = 0; i < 8; i++)
+        ps->sets[set][i] = ~ps->sets[set][i];
+    }
+    return tree_add(ps, (Tree){.type = T_SET, .set = set});
+  }
+  case '\0':
+  case '{':
+  case '}':
+  case '+':
+  case '?':
+  case '<':
+  case '>':
+  case 'b':
+  case 'B':
+  case '`':
+  case '\'':
+    ps->error = true;
+    return 0;
+  default:
+    if (c >= '1' && c <= '9') {
+      ps->error = true;
+      return 0;
+    }
+    return literal(ps, c);
+  }
+}
+
+static int parse_number(Parser *ps) {
+  int n = 0;
+  while (isdigit((unsigned char)*ps->p) && n <= REPEAT_MAX)
+    n = n * 10 + (*ps->p++ - '0');
+  return n;
+}
+
+// Applies any '*', \+, \? and \{m,n\} following atom t. Like glibc, refuses
+// a '*' or \{m,n\} straight after any of them.
+static int parse_repeats(Parser *ps, int t) {
+  for (bool repeated = false; !ps->error; repeated = true) {
+    int min, max;
+    if (repeated &&
+        (ps->p[0] == '*' || (ps->p[0] == '\\' && ps->p[1] == '{'))) {
+      ps->error = true;
+      return 0;
+    } else if (ps->p[0] == '*') {
+      ps->p++;
+      min = 0;
+      max = -1;
+    } else if (ps->p[0] == '\\' && ps->p[1] == '+') {
+      ps->p += 2;
+      min = 1;
+      max = -1;
+    } else if (ps->p[0] == '\\' && ps->p[1] == '?') {
+      ps->p += 2;
+      min = 0;
+      max = 1;
+    } else if (ps->p[0] == '\\' && ps->p[1] == '{') {
+      ps->p += 2;
+      min = max = parse_number(ps);
+      if (*ps->p == ',') {
+        ps->p++;
+        max = isdigit((unsigned char)*ps->p) ? parse_number(ps) : -1;
+      }
+      if (ps->p[0] != '\\' || ps->p[1] != '}' || min > REPEAT_MAX ||
+          max > REPEAT_MAX || (max >= 0 && max < min)) {
+        ps->error = true;
+        return 0;
+      }
+      ps->p += 2;
+    } else {
+      return t;
+    }
+    t = tree_add(ps, (Tree){.type = T_REPEAT, .a = t, .min = min, .max = max});
+  }
+  return t;
+}
+
+static bool branch_end(const char *p) {
+  return *p == '\0' || (p[0] == '\\' && (p[1] == '|' || p[1] == ')'));
+}
+
+// A sequence of pieces up to the end of the pattern, \| or \). As in GNU
+// basic regular expressions, '^' is an anchor at the start of a branch and
+// '$' at its end, and literal anywhere else.
+static int parse_branch(Parser *ps) {
+  int t = -1;
+  bool first = true;
+  while (!ps->error && !branch_end(ps->p)) {
+    int piece;
+    // glibc lets anchors inside groups match in surprising places, so
+    // patterns with those are left to it.
+    if (ps->depth > 0 && ((first && *ps->p == '^') ||
+                          (*ps->p == '$' && branch_end(ps->p + 1)))) {
+      ps->error = true;
+      return 0;
+    } else if (first && *ps->p == '^') {
+      ps->p++;
+      piece = tree_add(ps, (Tree){.type = T_BOL});
+    } else if (*ps->p == '$' && branch_end(ps->p + 1)) {
+      ps->p++;
+      piece = tree_add(ps, (Tree){.type = T_EOL});
+    } else {
+      piece = parse_repeats(ps, parse_atom(ps));
+    }
+    first = false;
+    t = t < 0 ? piece
+              : tree_add(ps, (Tree){.type = T_CAT, .a = t, .b = piece});
+  }
+  return t < 0 ? tree_add(ps, (Tree){.type = T_EMPTY}) : t;
+}
+
+static int parse_alt(Parser *ps) {
+  int t = parse_branch(ps);
+  while (!ps->error && ps->p[0] == '\\' && ps->p[1] == '|') {
+    ps->p += 2;
+    int b = parse_branch(ps);
+    t = tree_add(ps, (Tree){.type = T_ALT, .a = t, .b = b});
+  }
+  return t;
+}
+
+// NFA states. S_BOL and S_EOL hold only where the scan starts and ends, so
+// in the reversed NFA they stand for '$' and '^'.
+enum { S_SET, S_SPLIT, S_BOL, S_EOL, S_MATCH };
+
+typedef struct {
+  int type;
+  int out, out1;
+  int set;
+} State;
+
+typedef struct {
+  State *states;
+  int n, cap;
+  int start;
+  // The states that lead to each one without reading a byte, through
+  // splits and '$': those of state i are preds[pred_first[i],
+  // pred_first[i + 1]).
+  int *pred_first;
+  int *preds;
+} Nfa;
+
+typedef struct {
+  const Parser *ps;
+  Nfa *nfa;
+  bool reverse;
+  bool error;
+} Compiler;
+
+static int state_add(Compiler *c, State s) {
+  Nfa *nfa = c->nfa;
+  if (nfa->n == NFA_MAX) {
+    c->error = true;
+    return 0;
+  }
+  if (nfa->n == nfa->cap) {
+    nfa->cap = nfa->cap ? nfa->cap * 2 : 64;
+    nfa->states = realloc(nfa->states, sizeof(State) * nfa->cap);
+    if (nfa->states == NULL) {
+      die("realloc");
+    }
+  }
+  nfa->states[nfa->n] = s;
+  return nfa->n++;
+}
+
+// Compiles tree t to states that go on to next once it has matched, and
+// returns the first of them.
+static int emit(Compiler *c, int t, int next) {
+  if (c->error)
+    return 0;
+
+  const Tree *tree = &c->ps->tree[t];
+  switch (tree->type) {
+  case T_SET:
+    return state_add(c, (State){.type = S_SET, .out = next, .set = tree->set});
+  case T_BOL:
+    return state_add(c,
+                     (State){.type = c->reverse ? S_EOL : S_BOL, .out = next});
+  case T_EOL:
+    return state_add(c,
+                     (State){.type = c->reverse ? S_BOL : S_EOL, .out = next});
+  case T_CAT:
+    if (c->reverse)
+      return emit(c, tree->b, emit(c, tree->a, next));
+    return emit(c, tree->a, emit(c, tree->b, next));
+  case T_ALT: {
+    int a = emit(c, tree->a, next);
+    int b = emit(c, tree->b, next);
+    return state_add(c, (State){.type = S_SPLIT, .out = a, .out1 = b});
+  }
+  case T_REPEAT: {
+    int first = next;
+    if (tree->max < 0) {
+      first = state_add(c, (State){.type = S_SPLIT, .out1 = next});
+      int body = emit(c, tree->a, first);
+      if (!c->error)
+        c->nfa->states[first].out = body;
+    } else {
+      for (int i = tree->min; i < tree->max; i++) {
+        int body = emit(c, tree->a, first);
+        first = state_add(
+            c, (State){.type = S_SPLIT, .out = body, .out1 = next});
+      }
+    }
+    for (int i = 0; i < tree->min; i++)
+      first = emit(c, tree->a, first);
+    return first;
+  }
+  default:
+    return next;
+  }
+}
+
+// A DFA state: the NFA states it stands for, sorted, and whether a match
+// ends here, or would if the input ended here.
+typedef struct {
+  int *set;
+  int n;
+  unsigned hash;
+  bool accept;
+  bool accept_end;
+} DState;
+
+typedef struct {
+  const Nfa *nfa;
+  ByteSet *sets;
+  const uint8_t *classes;
+  const uint8_t *reps;
+  int nclasses;
+  // Whether a match may begin at any position rather than only where the
+  // scan starts.
+  bool unanchored;
+  // Set for a DFA run backwards whose states are the NFA states from which
+  // a match can be completed, see live_next.
+  bool live;
+
+  DState *states;
+  int nstates, cap;
+  // nclasses transitions per state, -1 until first taken.
+  int *trans;
+  // Open-addressed hash of states by set.
+  int *table;
+  // The start state for scans from position 0 and from elsewhere.
+  int start[2];
+  // Times the cache was thrown away.
+  int flushes;
+
+  // Bytes that keep an unanchored scan in its start state, where no match
+  // is under way, and how many bytes do not; escape is one that does not.
+  bool stay[256];
+  int nescape;
+  uint8_t escape;
+
+  int *stack;
+  int *list;
+  unsigned *mark;
+  unsigned gen;
+} Dfa;
+
+#define TABLE_SIZE (DFA_MAX * 2)
+
+static void dfa_init(Dfa *d, const Nfa *nfa, ByteSet *sets,
+                     const uint8_t *classes, const uint8_t *reps,
+                     int nclasses, bool unanchored) {
+  *d = (Dfa){.nfa = nfa,
+             .sets = sets,
+             .classes = classes,
+             .reps = reps,
+             .nclasses = nclasses,
+             .unanchored = unanchored,
+             .start = {-1, -1}};
+  d->table = malloc(sizeof(int) * TABLE_SIZE);
+  d->stack = malloc(sizeof(int) * (nfa->n * 3 + 1));
+  d->list = malloc(sizeof(int) * nfa->n);
+  d->mark = calloc(nfa->n, sizeof(unsigned));
+  if (d->table == NULL || d->stack == NULL || d->list == NULL ||
+      d->mark == NULL) {
+    die("malloc");
+  }
+  memset(d->table, -1, sizeof(int) * TABLE_SIZE);
+}
+
+static void dfa_flush(Dfa *d) {
+  for (int i = 0; i < d->nstates; i++)
+    free(d->states[i].set);
+  d->nstates = 0;
+  memset(d->table, -1, sizeof(int) * TABLE_SIZE);
+  d->start[0] = d->start[1] = -1;
+  d->flushes++;
+}
+
+static void dfa_free(Dfa *d) {
+  dfa_flush(d);
+  free(d->states);
+  free(d->trans);
+  free(d->table);
+  free(d->stack);
+  free(d->list);
+  free(d->mark);
+}
+
+static void next_gen(Dfa *d) {
+  if (++d->gen == 0) {
+    memset(d->mark, 0, sizeof(unsigned) * d->nfa->n);
+    d->gen = 1;
+  }
+}
+
+// Adds the states reachable from s without reading a byte to d->list,
+// leaving out splits and, unless at the start of the scan, S_BOL states.
+static void closure(Dfa *d, int s, bool begin, int *n) {
+  int top = 0;
+  d->stack[top++] = s;
+  while (top > 0) {
+    s = d->stack[--top];
+    if (d->mark[s] == d->gen)
+      continue;
+    d->mark[s] = d->gen;
+
+    const State *st = &d->nfa->states[s];
+    switch (st->type) {
+    case S_SPLIT:
+      d->stack[top++] = st->out1;
+      d->stack[top++] = st->out;
+      break;
+    case S_BOL:
+      if (begin)
+        d->stack[top++] = st->out;
+      break;
+    default:
+      d->list[(*n)++] = s;
+      break;
+    }
+  }
+}
+
+// Whether a match is reached from the states in set by the end of input.
+static bool accepts_at_end(Dfa *d, const int *set, int n) {
+  next_gen(d);
+  int top = 0;
+  for (int i = 0; i < n; i++)
+    d->stack[top++] = set[i];
+  while (top > 0) {
+    int s = d->stack[--top];
+    if (d->mark[s] == d->gen)
+      continue;
+    d->mark[s] = d->gen;
+
+    const State *st = &d->nfa->states[s];
+    switch (st->type) {
+    case S_MATCH:
+      return true;
+    case S_SPLIT:
+      d->stack[top++] = st->out1;
+      d->stack[top++] = st->out;
+      break;
+    case S_EOL:
+      d->stack[top++] = st->out;
+      break;
+    }
+  }
+  return false;
+}
+
+static int compare_ints(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+// Returns the state for the n NFA states in d->list, making it if needed.
+// Making one may flush the cache, invalidating every other state number.
+static int dfa_state(Dfa *d, int n) {
+  qsort(d->list, n, sizeof(int), compare_ints);
+  unsigned hash = 2166136261u;
+  for (int i = 0; i < n; i++)
+    hash = (hash ^ d->list[i]) * 16777619u;
+
+  unsigned slot = hash % TABLE_SIZE;
+  for (; d->table[slot] >= 0; slot = (slot + 1) % TABLE_SIZE) {
+    const DState *ds = &d->states[d->table[slot]];
+    if (ds->hash == hash && ds->n == n &&
+        memcmp(ds->set, d->list, sizeof(int) * n) == 0)
+      return d->table[slot];
+  }
+
+  if (d->nstates == DFA_MAX) {
+    dfa_flush(d);
+    slot = hash % TABLE_SIZE;
+  }
+  if (d->nstates == d->cap) {
+    d->cap = d->cap ? d->cap * 2 : 16;
+    d->states = realloc(d->states, sizeof(DState) * d->cap);
+    d->trans = realloc(d->trans, sizeof(int) * d->cap * d->nclasses);
+    if (d->states == NULL || d->trans == NULL) {
+      die("realloc");
+    }
+  }
+
+  int id = d->nstates++;
+  DState *ds = &d->states[id];
+  ds->set = malloc(sizeof(int) * (n ? n : 1));
+  if (ds->set == NULL) {
+    die("malloc");
+  }
+  memcpy(ds->set, d->list, sizeof(int) * n);
+  ds->n = n;
+  ds->hash = hash;
+  ds->accept = false;
+  for (int i = 0; i < n; i++) {
+    if (d->nfa->states[d->list[i]].type == S_MATCH)
+      ds->accept = true;
+  }
+  ds->accept_end = ds->accept || accepts_at_end(d, ds->set, n);
+  memset(&d->trans[id * d->nclasses], -1, sizeof(int) * d->nclasses);
+  d->table[slot] = id;
+  return id;
+}
+
+static int dfa_start(Dfa *d, bool begin) {
+  if (d->start[begin] < 0) {
+    next_gen(d);
+    int n = 0;
+    closure(d, d->nfa->start, begin, &n);
+    d->start[begin] = dfa_state(d, n);
+  }
+  return d->start[begin];
+}
+
+// Adds to d->list the states on the stack and every state leading to one
+// of them without reading a byte, passing '$' only at the end of the row.
+static int coclosure(Dfa *d, int top, bool end) {
+  int n = 0;
+  while (top > 0) {
+    int s = d->stack[--top];
+    if (d->mark[s] == d->gen)
+      continue;
+    d->mark[s] = d->gen;
+    d->list[n++] = s;
+
+    const Nfa *nfa = d->nfa;
+    for (int i = nfa->pred_first[s]; i < nfa->pred_first[s + 1]; i++) {
+      int p = nfa->preds[i];
+      if (d->mark[p] != d->gen && (end || nfa->states[p].type != S_EOL))
+        d->stack[top++] = p;
+    }
+  }
+  return n;
+}
+
+// The live states at the end of the row: those that reach the match
+// without reading anything.
+static int live_end(Dfa *d) {
+  if (d->start[0] < 0) {
+    next_gen(d);
+    // The match state is always the first.
+    d->stack[0] = 0;
+    d->start[0] = dfa_state(d, coclosure(d, 1, true));
+  }
+  return d->start[0];
+}
+
+// The live states before a byte of class cls, given those after it in s:
+// the match itself, and every state that reads the byte into one of s or
+// leads to one that does.
+static int live_next(Dfa *d, int s, int cls) {
+  unsigned c = d->reps[cls];
+  next_gen(d);
+  const DState *ds = &d->states[s];
+  for (int i = 0; i < ds->n; i++)
+    d->mark[ds->set[i]] = d->gen;
+
+  int top = 0;
+  d->stack[top++] = 0;
+  for (int i = 0; i < d->nfa->n; i++) {
+    const State *st = &d->nfa->states[i];
+    if (st->type == S_SET && d->mark[st->out] == d->gen &&
+        set_has(d->sets[st->set], c))
+      d->stack[top++] = i;
+  }
+  next_gen(d);
+  return coclosure(d, top, false);
+}
+
+// Follows the transition from state s on bytes of class cls.
+static int dfa_next(Dfa *d, int s, int cls) {
+  int t = d->trans[s * d->nclasses + cls];
+  if (t >= 0)
+    return t;
+
+  int n = 0;
+  if (d->live) {
+    n = live_next(d, s, cls);
+  } else {
+    unsigned c = d->reps[cls];
+    next_gen(d);
+    const DState *ds = &d->states[s];
+    for (int i = 0; i < ds->n; i++) {
+      const State *st = &d->nfa->states[ds->set[i]];
+      if (st->type == S_SET && set_has(d->sets[st->set], c))
+        closure(d, st->out, false, &n);
+    }
+    if (d->unanchored)
+      closure(d, d->nfa->start, false, &n);
+  }
+
+  int flushes = d->flushes;
+  t = dfa_state(d, n);
+  // Unless the cache was flushed and s no longer exists.
+  if (d->flushes == flushes)
+    d->trans[s * d->nclasses + cls] = t;
+  return t;
+}
+
+static void find_stay(Dfa *d) {
+  int idle = dfa_start(d, false);
+  d->nescape = 0;
+  for (int c = 0; c < 256; c++) {
+    d->stay[c] = dfa_next(d, idle, d->classes[c]) == idle;
+    if (!d->stay[c]) {
+      d->nescape++;
+      d->escape = c;
+    }
+  }
+}
+
+// Returns the first position from i on holding a byte that leaves the
+// start state.
+static int skip_idle(const Dfa *d, const uint8_t *s, int i, int len) {
+  if (d->nescape == 0)
+    return len;
+  if (d->nescape == 1) {
+    const uint8_t *p = memchr(s + i, d->escape, len - i);
+    return p ? p - s : len;
+  }
+  while (i < len && d->stay[s[i]])
+    i++;
+  return i;
+}
+
+// The same going backwards: returns the last position up to p, or 0,
+// preceded by a byte that leaves the start state.
+static int skip_idle_back(const Dfa *d, const uint8_t *s, int p) {
+  if (d->nescape == 0)
+    return 0;
+  if (d->nescape == 1) {
+    const uint8_t *q = memrchr(s, d->escape, p);
+    return q ? q - s + 1 : 0;
+  }
+  while (p > 0 && d->stay[s[p - 1]])
+    p--;
+  return p;
+}
+
+// Whether a match ends anywhere in s[off, len), scanning with an
+// unanchored DFA. Runs of bytes that cannot start a match are skipped
+// without stepping through them.
+static bool dfa_any(Dfa *d, const uint8_t *s, int len, int off) {
+  int st = dfa_start(d, off == 0);
+  for (int i = off;; i++) {
+    if (st == d->start[0])
+      i = skip_idle(d, s, i, len);
+    if (d->states[st].accept)
+      return true;
+    if (i == len)
+      return d->states[st].accept_end;
+
+    int cls = d->classes[s[i]];
+    int t = d->trans[st * d->nclasses + cls];
+    st = t >= 0 ? t : dfa_next(d, st, cls);
+  }
+}
+
+// Marks in begins each position of s where a match starts, scanning
+// backwards with an unanchored DFA of the reversed pattern.
+static void dfa_begins(Dfa *d, const uint8_t *s, int len, bool *begins) {
+  int st = dfa_start(d, true);
+  for (int p = len;; p--) {
+    if (st == d->start[0]) {
+      int q = skip_idle_back(d, s, p);
+      memset(&begins[q + 1], d->states[st].accept, p - q);
+      p = q;
+    }
+    const DState *ds = &d->states[st];
+    begins[p] = ds->accept || (p == 0 && ds->accept_end);
+    if (p == 0)
+      break;
+
+    int cls = d->classes[s[p - 1]];
+    int t = d->trans[st * d->nclasses + cls];
+    st = t >= 0 ? t : dfa_next(d, st, cls);
+  }
+}
+
+// Records in live[p] the live states at each position p of s, scanning
+// backwards. Returns false if the cache was flushed on the way, leaving the
+// states recorded before that meaningless.
+static bool dfa_live(Dfa *d, const uint8_t *s, int len, int *live) {
+  int flushes = d->flushes;
+  int st = live_end(d);
+  live[len] = st;
+  for (int p = len; p > 0; p--) {
+    int cls = d->classes[s[p - 1]];
+    int t = d->trans[st * d->nclasses + cls];
+    st = t >= 0 ? t : dfa_next(d, st, cls);
+    live[p - 1] = st;
+  }
+  return d->flushes == flushes;
+}
+
+// Whether a forward state and a live state have an NFA state in common,
+// remembered for pairs seen recently.
+typedef struct {
+  int f, c;
+  int fflushes, cflushes;
+  bool meet;
+} Meet;
+
+#define MEET_SIZE 1024
+
+typedef struct {
+  Parser ps;
+  Nfa forward, reverse;
+  // Bytes no part of the pattern tells apart share a class, and a
+  // representative byte for each class.
+  uint8_t classes[256];
+  uint8_t reps[256];
+  int nclasses;
+
+  // Finds whether a row matches at all, how far a match extends, where
+  // matches start and where they can still be completed.
+  Dfa scan, longest, backward, live;
+  // Set if every match has to start at position 0, as with "^foo".
+  bool anchored;
+
+  // Where matches start in the row last searched, see dfa_exec. Once its
+  // matches have been extended over more than twice its length, the live
+  // states at each position too, unless they could not all be kept.
+  const char *row;
+  regoff_t rowlen;
+  bool *begins;
+  long extended;
+  int *lives;
+  bool lived, bounded;
+  size_t capacity;
+  Meet meets[MEET_SIZE];
+} DfaPattern;
+
+// Whether a match under way in forward state f can still be completed,
+// given the live states c where it is.
+static bool dfa_meet(DfaPattern *p, int f, int c) {
+  Meet *m = &p->meets[((unsigned)f * 31 + c) % MEET_SIZE];
+  if (m->f == f && m->c == c && m->fflushes == p->longest.flushes &&
+      m->cflushes == p->live.flushes)
+    return m->meet;
+
+  const DState *x = &p->longest.states[f], *y = &p->live.states[c];
+  bool meet = false;
+  for (int i = 0, j = 0; !meet && i < x->n && j < y->n;) {
+    if (x->set[i] < y->set[j]) {
+      i++;
+    } else if (x->set[i] > y->set[j]) {
+      j++;
+    } else {
+      meet = true;
+    }
+  }
+  *m = (Meet){f, c, p->longest.flushes, p->live.flushes, meet};
+  return meet;
+}
+
+// Returns where the longest match starting at from ends, or -1. With live
+// states for the row, stops one byte past where the match ends rather than
+// wherever the DFA dies.
+static int dfa_longest(DfaPattern *p, const uint8_t *s, int len, int from,
+                       const int *lives) {
+  Dfa *d = &p->longest;
+  int st = dfa_start(d, from == 0);
+  int end = -1;
+  for (int i = from;; i++) {
+    const DState *ds = &d->states[st];
+    if (ds->accept)
+      end = i;
+    if (i == len) {
+      if (ds->accept_end)
+        end = len;
+      break;
+    }
+    if (ds->n == 0 || (lives && !dfa_meet(p, st, lives[i])))
+      break;
+    st = dfa_next(d, st, d->classes[s[i]]);
+    p->extended++;
+  }
+  return end;
+}
+
+static void dfa_pattern_free(void *impl) {
+  DfaPattern *p = impl;
+  if (p->scan.table) {
+    dfa_free(&p->scan);
+    dfa_free(&p->longest);
+    dfa_free(&p->backward);
+    dfa_free(&p->live);
+  }
+  free(p->ps.tree);
+  free(p->ps.sets);
+  free(p->forward.states);
+  free(p->forward.pred_first);
+  free(p->forward.preds);
+  free(p->reverse.states);
+  free(p->begins);
+  free(p->lives);
+  free(p);
+}
+
+static bool build_nfa(DfaPattern *p, int root, Nfa *nfa, bool reverse) {
+  Compiler c = {.ps = &p->ps, .nfa = nfa, .reverse = reverse};
+  int match = state_add(&c, (State){.type = S_MATCH});
+  nfa->start = emit(&c, root, match);
+  return !c.error;
+}
+
+// Lists the states leading to each state of nfa through splits and '$'.
+static void build_preds(Nfa *nfa) {
+  nfa->pred_first = calloc(nfa->n + 1, sizeof(int));
+  nfa->preds = malloc(sizeof(int) * (nfa->n * 2 + 1));
+  if (nfa->pred_first == NULL || nfa->preds == NULL) {
+    die("malloc");
+  }
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < nfa->n; i++) {
+      const State *st = &nfa->states[i];
+      int outs[2], n = 0;
+      if (st->type == S_SPLIT) {
+        outs[n++] = st->out;
+        outs[n++] = st->out1;
+      } else if (st->type == S_EOL) {
+        outs[n++] = st->out;
+      }
+      for (int k = 0; k < n; k++) {
+        if (pass == 0)
+          nfa->pred_first[outs[k] + 1]++;
+        else
+          nfa->preds[nfa->pred_first[outs[k]]++] = i;
+      }
+    }
+    if (pass == 0) {
+      for (int i = 0; i < nfa->n; i++)
+        nfa->pred_first[i + 1] += nfa->pred_first[i];
+    } else {
+      // Filling them in moved each start to the next state's.
+      for (int i = nfa->n; i > 0; i--)
+        nfa->pred_first[i] = nfa->pred_first[i - 1];
+      nfa->pred_first[0] = 0;
+    }
+  }
+}
+
+// Splits the bytes into classes that every set in the pattern either
+// contains or excludes entirely.
+static void build_classes(DfaPattern *p) {
+  memset(p->classes, 0, sizeof(p->classes));
+  p->nclasses = 1;
+  for (int s = 0; s < p->ps.nsets; s++) {
+    int map[512];
+    memset(map, -1, sizeof(map));
+    int n = 0;
+    for (int c = 0; c < 256; c++) {
+      int key = p->classes[c] * 2 + set_has(p->ps.sets[s], c);
+      if (map[key] < 0)
+        map[key] = n++;
+      p->classes[c] = map[key];
+    }
+    p->nclasses = n;
+  }
+  for (int c = 255; c >= 0; c--)
+    p->reps[p->classes[c]] = c;
+}
+
+static void *dfa_compile(const char *pattern) {
+  DfaPattern *p = calloc(1, sizeof(DfaPattern));
+  if (p == NULL) {
+    die("calloc");
+  }
+
+  p->ps.p = pattern;
+  int root = parse_alt(&p->ps);
+  // A '\)' with no '\(' before it.
+  if (!p->ps.error && *p->ps.p != '\0')
+    p->ps.error = true;
+  if (p->ps.error || !build_nfa(p, root, &p->forward, false) ||
+      !build_nfa(p, root, &p->reverse, true)) {
+    dfa_pattern_free(p);
+    return NULL;
+  }
+
+  build_classes(p);
+  dfa_init(&p->scan, &p->forward, p->ps.sets, p->classes, p->reps,
+           p->nclasses, true);
+  dfa_init(&p->longest, &p->forward, p->ps.sets, p->classes, p->reps,
+           p->nclasses, false);
+  dfa_init(&p->backward, &p->reverse, p->ps.sets, p->classes, p->reps,
+           p->nclasses, true);
+  build_preds(&p->forward);
+  dfa_init(&p->live, &p->forward, p->ps.sets, p->classes, p->reps,
+           p->nclasses, false);
+  p->live.live = true;
+  for (int i = 0; i < MEET_SIZE; i++)
+    p->meets[i].f = -1;
+  find_stay(&p->scan);
+  find_stay(&p->backward);
+  p->anchored = p->scan.states[p->scan.start[0]].n == 0;
+  return p;
+}
+
+// Successive matches in a row are looked for from increasing offsets,
+// starting at 0. The first call finds out where in the row matches start,
+// with one backwards pass, and later calls for the same row reuse that.
+static bool dfa_exec(void *impl, const char *s, regoff_t len, regoff_t off,
+                     regmatch_t *match) {
+  DfaPattern *p = impl;
+  const uint8_t *u = (const uint8_t *)s;
+
+  if (p->anchored) {
+    if (off > 0 || !dfa_any(&p->scan, u, len, 0))
+      return false;
+    match->rm_so = 0;
+    match->rm_eo = dfa_longest(p, u, len, 0, NULL);
+    return true;
+  }
+
+  if (off == 0 || s != p->row || len != p->rowlen) {
+    p->row = NULL;
+    // Most rows do not match at all, and one forward pass settles that.
+    if (!dfa_any(&p->scan, u, len, off))
+      return false;
+
+    if ((size_t)len + 1 > p->capacity) {
+      p->capacity = (size_t)len + 1 > p->capacity * 2 ? (size_t)len + 1
+                                                      : p->capacity * 2;
+      free(p->begins);
+      free(p->lives);
+      p->begins = malloc(p->capacity);
+      p->lives = malloc(sizeof(int) * p->capacity);
+      if (p->begins == NULL || p->lives == NULL) {
+        die("malloc");
+      }
+    }
+    dfa_begins(&p->backward, u, len, p->begins);
+    p->row = s;
+    p->rowlen = len;
+    p->extended = 0;
+    p->lived = p->bounded = false;
+  }
+
+  // Matches usually end soon after they start, but with a pattern like
+  // "a\|a.*z" each one reads on to the end of the row. Once that happens
+  // too often, a backwards pass finds where matches can still be completed
+  // so that they stop where they end.
+  if (!p->lived && p->extended > 2 * (long)len) {
+    p->lived = true;
+    // A flush part way leaves states from before it unusable. Another pass
+    // from an empty cache only fails for rows that need more states than
+    // it holds, whose matches are then extended as far as they go.
+    p->bounded = dfa_live(&p->live, u, len, p->lives);
+    if (!p->bounded) {
+      dfa_flush(&p->live);
+      p->bounded = dfa_live(&p->live, u, len, p->lives);
+    }
+  }
+
+  regoff_t so = off;
+  while (so <= len && !p->begins[so])
+    so++;
+  if (so > len)
+    return false;
+
+  match->rm_so = so;
+  match->rm_eo = dfa_longest(p, u, len, so, p->bounded ? p->lives : NULL);
+  return true;
+}
+
+const MatcherEngine dfa_engine = {"dfa", dfa_compile, dfa_exec,
+                                  dfa_pattern_free};
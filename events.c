@@ -0,0 +1,74 @@
+#define _GNU_SOURCE
+
+#include "events.h"
+#include "common.h"
+#include "loggy.h"
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+// Sets up what the main loop sleeps on besides the tty and the input files:
+// a signalfd for terminal resizes, and an eventfd that background threads
+// write to when they have something for the main thread.
+void events_init(Loggy *l) {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGWINCH);
+  // Blocked before any thread is started, so that every thread inherits the
+  // mask and the signal stays pending for the signalfd.
+  if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0) {
+    die("pthread_sigmask");
+  }
+
+  l->events.sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (l->events.sigfd == -1) {
+    die("signalfd");
+  }
+  l->events.wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (l->events.wakefd == -1) {
+    die("eventfd");
+  }
+}
+
+// Wakes the main loop from another thread.
+void events_wake(int fd) {
+  uint64_t one = 1;
+  if (write(fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+    die("write");
+  }
+}
+
+// Sleeps until a key, a resize, new file data or word from a background
+// thread arrives, or for at most timeout milliseconds; -1 waits as long as
+// it takes. Returns true if the terminal was resized.
+bool events_wait(Loggy *l, int timeout) {
+  Events *e = &l->events;
+  struct pollfd fds[5];
+  int n = 0;
+  fds[n++] = (struct pollfd){.fd = STDIN_FILENO, .events = POLLIN};
+  fds[n++] = (struct pollfd){.fd = e->sigfd, .events = POLLIN};
+  fds[n++] = (struct pollfd){.fd = e->wakefd, .events = POLLIN};
+  if (l->follow.enabled)
+    fds[n++] = (struct pollfd){.fd = l->follow.fd, .events = POLLIN};
+  if (l->stream.fd != -1)
+    fds[n++] = (struct pollfd){.fd = l->stream.fd, .events = POLLIN};
+
+  if (poll(fds, n, timeout) == -1 && errno != EINTR) {
+    die("poll");
+  }
+
+  uint64_t count;
+  if (read(e->wakefd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+    die("read");
+  }
+
+  bool resized = false;
+  struct signalfd_siginfo info;
+  while (read(e->sigfd, &info, sizeof(info)) == sizeof(info))
+    resized = true;
+  return resized;
+}
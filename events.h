@@ -0,0 +1,10 @@
+#ifndef EVENTS_H_
+#define EVENTS_H_
+
+#include "loggy.h"
+
+void events_init(Loggy *l);
+void events_wake(int fd);
+bool events_wait(Loggy *l, int timeout);
+
+#endif // EVENTS_H_
@@ -0,0 +1,157 @@
+#include "filter.h"
+#include "common.h"
+#include "loggy.h"
+#include "matchlist.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The rows on screen are positions in the current view: every row of the
+// file, or only the rows in the filter. cy and rowoff are view positions.
+
+int view_len(Loggy *l) {
+  return l->filter.enabled ? l->filter.len : l->nrows;
+}
+
+int view_row(Loggy *l, int i) {
+  if (!l->filter.enabled)
+    return i;
+  if (i >= l->filter.len)
+    return l->nrows;
+  return l->filter.rows[i];
+}
+
+// Returns the view position of row, or of the first row after it that is in
+// the view, clamped to the last position.
+int view_find(Loggy *l, int row) {
+  Filter *f = &l->filter;
+  if (!f->enabled)
+    return row;
+
+  int left = 0;
+  int right = f->len;
+  while (left < right) {
+    int middle = left + (right - left) / 2;
+    if (f->rows[middle] < row) {
+      left = middle + 1;
+    } else {
+      right = middle;
+    }
+  }
+  if (left >= f->len)
+    left = f->len - 1;
+  return left < 0 ? 0 : left;
+}
+
+static void filter_append(Filter *f, int row) {
+  if (f->len > 0 && f->rows[f->len - 1] == row)
+    return;
+
+  if (f->len == f->capacity) {
+    int capacity = f->capacity ? f->capacity * 2 : 1024;
+    int *rows = realloc(f->rows, sizeof(int) * capacity);
+    if (rows == NULL) {
+      die("realloc");
+    }
+    f->rows = rows;
+    f->capacity = capacity;
+  }
+  f->rows[f->len++] = row;
+}
+
+// Adds the rows of matches found since the last call.
+static void filter_consume(Loggy *l) {
+  Filter *f = &l->filter;
+  MatchCursor c;
+  int row, col;
+  matchlist_seek(&l->matches.list, f->consumed, &c);
+  while (matchlist_next(&c, &row, &col))
+    filter_append(f, row);
+  f->consumed = l->matches.list.len;
+}
+
+// Rebuilds the filter from scratch, keeping the cursor on row (or the next
+// row still in the view) at the same height on screen.
+static void filter_rebuild(Loggy *l, int row) {
+  Filter *f = &l->filter;
+  Matches *m = &l->matches;
+  int height = l->cy - l->rowoff;
+
+  f->len = 0;
+  f->consumed = 0;
+  f->version = m->version;
+  filter_consume(l);
+
+  l->cy = view_find(l, row);
+  l->rowoff = l->cy - height > 0 ? l->cy - height : 0;
+}
+
+// Switches between the whole file and only the rows matching the current
+// search. Neither direction copies or rescans any rows.
+void filter_toggle(Loggy *l) {
+  Filter *f = &l->filter;
+
+  if (f->enabled) {
+    int row = view_row(l, l->cy);
+    int height = l->cy - l->rowoff;
+    f->enabled = false;
+    l->cy = row < l->nrows ? row : 0;
+    l->rowoff = l->cy - height > 0 ? l->cy - height : 0;
+    return;
+  }
+
+  if (l->matches.pattern == NULL) {
+    write_status_message(l, "Search for a pattern to filter by first");
+    return;
+  }
+  if (l->matches.count_only) {
+    write_status_message(l, "Matches are only being counted; press # first");
+    return;
+  }
+
+  int row = l->cy;
+  f->enabled = true;
+  filter_rebuild(l, row);
+}
+
+// Picks up matches found since the last call. Returns true if the view
+// changed.
+bool filter_update(Loggy *l) {
+  Filter *f = &l->filter;
+  Matches *m = &l->matches;
+  if (!f->enabled)
+    return false;
+
+  if (m->pattern == NULL || m->count_only) {
+    filter_toggle(l);
+    return true;
+  }
+
+  // Matches were dropped or reordered, not just appended.
+  if (f->version != m->version || f->consumed > m->list.len) {
+    filter_rebuild(l, view_row(l, l->cy));
+    return true;
+  }
+
+  if (f->consumed == m->list.len)
+    return false;
+
+  filter_consume(l);
+  return true;
+}
+
+// Drops the first n rows of the file from the filter and renumbers the rest.
+// Returns how many view positions went away.
+int filter_evict(Loggy *l, int n) {
+  Filter *f = &l->filter;
+  if (!f->enabled)
+    return n;
+
+  int drop = 0;
+  while (drop < f->len && f->rows[drop] < n)
+    drop++;
+  f->len -= drop;
+  memmove(f->rows, &f->rows[drop], sizeof(int) * f->len);
+  for (int i = 0; i < f->len; i++)
+    f->rows[i] -= n;
+  return drop;
+}
@@ -0,0 +1,14 @@
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include "loggy.h"
+
+void filter_toggle(Loggy *l);
+bool filter_update(Loggy *l);
+int filter_evict(Loggy *l, int n);
+
+int view_len(Loggy *l);
+int view_row(Loggy *l, int i);
+int view_find(Loggy *l, int row);
+
+#endif // FILTER_H_
@@ -0,0 +1,185 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include "follow.h"
+#include "common.h"
+#include "filter.h"
+#include "indexer.h"
+#include "loggy.h"
+#include "search.h"
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *base_name(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+// (Re)arms the watch on the file itself and remembers which inode it is, so
+// a rotated file can be told apart from one that was only appended to.
+static void watch_file(Loggy *l) {
+  Follow *f = &l->follow;
+  if (f->wd != -1) {
+    inotify_rm_watch(f->fd, f->wd);
+  }
+  f->wd = inotify_add_watch(f->fd, l->filename,
+                            IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF |
+                                IN_DELETE_SELF);
+
+  struct stat st;
+  if (stat(l->filename, &st) == 0) {
+    f->dev = st.st_dev;
+    f->ino = st.st_ino;
+  }
+}
+
+void follow_start(Loggy *l) {
+  Follow *f = &l->follow;
+  if (f->enabled)
+    return;
+
+  struct stat st;
+  if (l->filename == NULL || stat(l->filename, &st) == -1 ||
+      !S_ISREG(st.st_mode)) {
+    write_status_message(l, "Follow mode needs a regular file");
+    return;
+  }
+  // A gzip file is read from the start through its index, so anything
+  // appended would mean inflating and indexing all of it again.
+  if (l->gz) {
+    write_status_message(l, "Follow mode needs an uncompressed file");
+    return;
+  }
+
+  f->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (f->fd == -1) {
+    die("inotify_init1");
+  }
+  f->wd = -1;
+  watch_file(l);
+
+  // Watch the directory as well: after a rotation the new file shows up
+  // there under the same name.
+  char dir[PATH_MAX];
+  const char *name = base_name(l->filename);
+  int dirlen = name - l->filename;
+  if (dirlen == 0) {
+    snprintf(dir, sizeof(dir), ".");
+  } else {
+    snprintf(dir, sizeof(dir), "%.*s", dirlen, l->filename);
+  }
+  f->dirwd = inotify_add_watch(f->fd, dir, IN_CREATE | IN_MOVED_TO);
+
+  f->enabled = true;
+  f->changed = true;
+  f->stick = true;
+  f->cy = l->cy;
+}
+
+void follow_stop(Loggy *l) {
+  Follow *f = &l->follow;
+  if (!f->enabled)
+    return;
+
+  close(f->fd);
+  f->enabled = false;
+}
+
+static bool drain_events(Loggy *l) {
+  Follow *f = &l->follow;
+  const char *name = base_name(l->filename);
+  bool changed = false;
+
+  char buf[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  while ((len = read(f->fd, buf, sizeof(buf))) > 0) {
+    const struct inotify_event *ev;
+    for (char *p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+      ev = (const struct inotify_event *)p;
+      if (ev->wd == f->dirwd && (ev->len == 0 || strcmp(ev->name, name) != 0))
+        continue;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+static void reopen(Loggy *l) {
+  open_file(l, l->filename);
+  watch_file(l);
+}
+
+// Extends the mapping over bytes appended since the last check and indexes
+// only those. A trailing line that had no newline yet is indexed again,
+// since it may have been completed.
+static bool grow(Loggy *l, size_t size) {
+  size_t from = l->size;
+  if (l->data[l->size - 1] != '\n' && l->nrows > 0) {
+    l->nrows--;
+    from = l->rows[l->nrows].off;
+    search_truncate(l, l->nrows);
+  }
+
+  char *data = mremap(l->data, l->size, size, MREMAP_MAYMOVE);
+  if (data == MAP_FAILED) {
+    reopen(l);
+    return true;
+  }
+  l->data = data;
+  l->size = size;
+
+  indexer_extend(l, from);
+  return true;
+}
+
+static bool refresh(Loggy *l) {
+  Follow *f = &l->follow;
+  struct stat st;
+  if (stat(l->filename, &st) == -1) {
+    // Rotated away and not recreated yet; the directory watch tells us when.
+    return false;
+  }
+
+  if (st.st_dev != f->dev || st.st_ino != f->ino ||
+      (size_t)st.st_size < l->size || (!l->mapped && st.st_size > 0)) {
+    reopen(l);
+    return true;
+  }
+
+  if ((size_t)st.st_size == l->size)
+    return false;
+  return grow(l, st.st_size);
+}
+
+bool follow_poll(Loggy *l) {
+  Follow *f = &l->follow;
+  if (!f->enabled)
+    return false;
+
+  // Only keep the view pinned to the end if the user left the cursor there.
+  if (l->cy != f->cy) {
+    f->stick = view_len(l) == 0 || l->cy >= view_len(l) - 1;
+  }
+
+  bool updated = false;
+  if (drain_events(l) || f->changed) {
+    // Appends that race with the initial scan are picked up once it is done.
+    f->changed = l->indexer.running;
+    if (!f->changed) {
+      updated = refresh(l);
+    }
+  }
+
+  if (f->stick && view_len(l) > 0 && l->cy != view_len(l) - 1) {
+    l->cy = view_len(l) - 1;
+    updated = true;
+  }
+  f->cy = l->cy;
+  return updated;
+}
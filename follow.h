@@ -0,0 +1,10 @@
+#ifndef FOLLOW_H_
+#define FOLLOW_H_
+
+#include "loggy.h"
+
+void follow_start(Loggy *l);
+void follow_stop(Loggy *l);
+bool follow_poll(Loggy *l);
+
+#endif // FOLLOW_H_
@@ -0,0 +1,364 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include "gz.h"
+#include "common.h"
+#include "indexer.h"
+#include "loggy.h"
+#include "scan.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+// Uncompressed bytes between checkpoints. A jump decompresses at most about
+// this much, and each checkpoint keeps a compressed 32 KiB window.
+#define SPAN (4 << 20)
+#define WINDOW 32768
+// Decompressed bytes kept around for rows that were recently looked at.
+#define NSPANS 4
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+// Decoder state at a deflate block boundary, enough to resume inflating at
+// uncompressed offset out without the data before it: the first full input
+// byte, the bits of the byte before it still to be read, and the window the
+// following blocks may refer back to. The first checkpoint starts the gzip
+// stream from its header and has bits set to -1.
+typedef struct {
+  size_t in;
+  size_t out;
+  int bits;
+  unsigned char *window;
+  uLong windowlen;
+  uInt dictlen;
+} Point;
+
+// Decompressed bytes [start, start + len) for rows to point into.
+typedef struct {
+  size_t start;
+  size_t len;
+  size_t capacity;
+  char *data;
+  unsigned long used;
+} Span;
+
+struct Gz {
+  const unsigned char *map;
+  size_t size;
+  Indexer *idx;
+
+  // Appended to by the indexing thread, guarded by lock.
+  pthread_mutex_t lock;
+  Point *points;
+  int npoints;
+  int capacity;
+  // Uncompressed bytes inflated so far; published rows all end before it.
+  size_t out;
+
+  // Main thread only.
+  Span spans[NSPANS];
+  unsigned long tick;
+};
+
+static void point_add(Gz *gz, z_stream *s, size_t in, size_t out, int bits) {
+  Point p = {.in = in, .out = out, .bits = bits};
+  if (bits >= 0) {
+    unsigned char dict[WINDOW];
+    p.dictlen = sizeof(dict);
+    inflateGetDictionary(s, dict, &p.dictlen);
+    p.windowlen = compressBound(p.dictlen);
+    p.window = malloc(p.windowlen);
+    if (p.window == NULL ||
+        compress2(p.window, &p.windowlen, dict, p.dictlen, 1) != Z_OK) {
+      free(p.window);
+      return;
+    }
+  }
+
+  pthread_mutex_lock(&gz->lock);
+  if (gz->npoints == gz->capacity) {
+    gz->capacity = gz->capacity ? gz->capacity * 2 : 64;
+    gz->points = realloc(gz->points, sizeof(Point) * gz->capacity);
+    if (gz->points == NULL) {
+      die("realloc");
+    }
+  }
+  gz->points[gz->npoints++] = p;
+  pthread_mutex_unlock(&gz->lock);
+}
+
+static void set_out(Gz *gz, size_t out) {
+  pthread_mutex_lock(&gz->lock);
+  gz->out = out;
+  pthread_mutex_unlock(&gz->lock);
+}
+
+// zlib counts input in uInt, so the mapping is fed to it a piece at a time.
+static void feed(Gz *gz, z_stream *s, size_t *in) {
+  if (s->avail_in > 0 || *in >= gz->size)
+    return;
+  size_t n = gz->size - *in < UINT_MAX ? gz->size - *in : UINT_MAX;
+  s->next_in = (unsigned char *)&gz->map[*in];
+  s->avail_in = n;
+  *in += n;
+}
+
+// Inflates the whole file once, turning newlines into rows and leaving a
+// checkpoint about every SPAN bytes. Rows are published through the indexer
+// like those of a mapped file; their offsets are into the uncompressed data.
+static void *index_thread(void *arg) {
+  Gz *gz = arg;
+  Indexer *idx = gz->idx;
+
+  Row *batch = NULL;
+  int nbatch = 0, capacity = 0, ncols = 0;
+  size_t nl[4096];
+  unsigned char out[1 << 16];
+
+  z_stream s = {0};
+  if (inflateInit2(&s, 15 + 32) != Z_OK) {
+    die("inflateInit2");
+  }
+  point_add(gz, &s, 0, 0, -1);
+
+  // in is how much input has been handed to zlib; in - avail_in is used.
+  size_t in = 0, total = 0, last = 0, published = 0;
+  size_t start = 0, crrun = 0;
+  int ret = Z_OK;
+  while (!indexer_should_stop(idx)) {
+    feed(gz, &s, &in);
+    s.next_out = out;
+    s.avail_out = sizeof(out);
+    ret = inflate(&s, Z_BLOCK);
+    if (ret != Z_OK && ret != Z_STREAM_END)
+      break;
+
+    size_t n = sizeof(out) - s.avail_out;
+    size_t pos = 0;
+    while (pos < n) {
+      size_t k = scan_newlines((char *)out, pos, n, nl, ARRAY_SIZE(nl));
+      if (nbatch + (int)k > capacity) {
+        while (nbatch + (int)k > capacity)
+          capacity = capacity ? capacity * 2 : 1024;
+        batch = realloc(batch, sizeof(Row) * capacity);
+        if (batch == NULL) {
+          die("realloc");
+        }
+      }
+      for (size_t i = 0; i < k; i++) {
+        // Carriage returns before the newline, counting any at the end of
+        // the previous buffer when this one has only those.
+        size_t from = start > total ? start - total : 0;
+        size_t end = nl[i];
+        while (end > from && out[end - 1] == '\r')
+          end--;
+        size_t crs = nl[i] - end + (end == from ? crrun : 0);
+        size_t len = total + nl[i] - start - crs;
+        batch[nbatch++] = (Row){.off = start, .len = len};
+        if ((int)len > ncols)
+          ncols = len;
+        start = total + nl[i] + 1;
+        crrun = 0;
+      }
+      pos = k < ARRAY_SIZE(nl) ? n : nl[k - 1] + 1;
+    }
+    size_t from = start > total ? start - total : 0;
+    size_t end = n;
+    while (end > from && out[end - 1] == '\r')
+      end--;
+    crrun = n - end + (end == from ? crrun : 0);
+    total += n;
+
+    if (ret == Z_STREAM_END) {
+      // Concatenated gzip members, as written by pigz or cat.
+      feed(gz, &s, &in);
+      if (s.avail_in == 0)
+        break;
+      inflateReset(&s);
+    } else if ((s.data_type & 128) && !(s.data_type & 64) &&
+               total - last >= SPAN) {
+      point_add(gz, &s, in - s.avail_in, total, s.data_type & 7);
+      last = total;
+    }
+
+    if (total - published >= (1 << 20)) {
+      set_out(gz, total);
+      indexer_publish(idx, batch, nbatch, ncols, in - s.avail_in);
+      nbatch = 0;
+      published = total;
+    }
+  }
+  inflateEnd(&s);
+
+  set_out(gz, total);
+  if (nbatch > 0)
+    indexer_publish(idx, batch, nbatch, ncols, in - s.avail_in);
+  // A final line without a trailing newline.
+  if (start < total && !indexer_should_stop(idx)) {
+    Row row = {.off = start, .len = total - start - crrun};
+    indexer_publish(idx, &row, 1, (int)row.len > ncols ? row.len : ncols,
+                    gz->size);
+  }
+  free(batch);
+
+  indexer_finish(idx);
+  return NULL;
+}
+
+// Opens fd as a gzip file if it is one. Rows show up as the background
+// thread inflates it; row_data reads them back through gz_data.
+bool gz_open(Loggy *l, int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size < 18)
+    return false;
+  unsigned char *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    return false;
+  if (map[0] != 0x1f || map[1] != 0x8b) {
+    munmap(map, st.st_size);
+    return false;
+  }
+
+  Gz *gz = calloc(1, sizeof(Gz));
+  if (gz == NULL) {
+    die("calloc");
+  }
+  gz->map = map;
+  gz->size = st.st_size;
+  gz->idx = &l->indexer;
+  pthread_mutex_init(&gz->lock, NULL);
+  l->gz = gz;
+  // Only used for the indexing progress shown in the status bar.
+  l->size = st.st_size;
+
+  Indexer *idx = &l->indexer;
+  *idx = (Indexer){
+      .size = gz->size, .wake = l->events.wakefd, .running = true};
+  pthread_mutex_init(&idx->lock, NULL);
+  if (pthread_create(&idx->thread, NULL, index_thread, gz) != 0) {
+    die("pthread_create");
+  }
+  return true;
+}
+
+// Inflates from checkpoint p into sp until it reaches uncompressed offset
+// end. Whatever cannot be inflated, in a truncated or corrupt file, reads
+// as zeros.
+static void inflate_span(Gz *gz, Point *p, Span *sp, size_t end) {
+  sp->start = p->out;
+  sp->len = 0;
+  size_t want = end - p->out;
+  if (want > sp->capacity) {
+    sp->data = realloc(sp->data, want);
+    if (sp->data == NULL) {
+      die("realloc");
+    }
+    sp->capacity = want;
+  }
+
+  z_stream s = {0};
+  size_t in = p->in;
+  bool raw = p->bits >= 0;
+  if (raw) {
+    unsigned char dict[WINDOW];
+    uLongf dictlen = sizeof(dict);
+    if (inflateInit2(&s, -15) != Z_OK ||
+        uncompress(dict, &dictlen, p->window, p->windowlen) != Z_OK)
+      goto out;
+    if (p->bits)
+      inflatePrime(&s, p->bits, gz->map[p->in - 1] >> (8 - p->bits));
+    inflateSetDictionary(&s, dict, dictlen);
+  } else if (inflateInit2(&s, 15 + 32) != Z_OK) {
+    goto out;
+  }
+
+  while (sp->len < want) {
+    feed(gz, &s, &in);
+    size_t room = want - sp->len;
+    s.next_out = (unsigned char *)&sp->data[sp->len];
+    s.avail_out = room < UINT_MAX ? room : UINT_MAX;
+    int ret = inflate(&s, Z_NO_FLUSH);
+    sp->len += (room < UINT_MAX ? room : UINT_MAX) - s.avail_out;
+    if (ret == Z_STREAM_END) {
+      // The next gzip member starts after this one's 8-byte trailer, which
+      // a raw inflate leaves unread.
+      if (raw) {
+        size_t skip = s.avail_in < 8 ? s.avail_in : 8;
+        s.next_in += skip;
+        s.avail_in -= skip;
+        in += 8 - skip;
+        raw = false;
+        inflateReset2(&s, 15 + 16);
+      } else {
+        inflateReset(&s);
+      }
+      feed(gz, &s, &in);
+      if (s.avail_in == 0)
+        break;
+    } else if (ret != Z_OK) {
+      break;
+    }
+  }
+
+out:
+  inflateEnd(&s);
+  memset(&sp->data[sp->len], 0, want - sp->len);
+  sp->len = want;
+}
+
+// Returns the uncompressed bytes [off, off + len). The pointer stays valid
+// until the next call; only the main thread may call this.
+char *gz_data(Loggy *l, size_t off, size_t len) {
+  Gz *gz = l->gz;
+  Span *lru = &gz->spans[0];
+  for (int i = 0; i < NSPANS; i++) {
+    Span *sp = &gz->spans[i];
+    if (sp->data && sp->start <= off && off + len <= sp->start + sp->len) {
+      sp->used = ++gz->tick;
+      return &sp->data[off - sp->start];
+    }
+    if (sp->used < lru->used)
+      lru = sp;
+  }
+
+  pthread_mutex_lock(&gz->lock);
+  int left = 0, right = gz->npoints - 1;
+  while (left < right) {
+    int middle = left + (right - left + 1) / 2;
+    if (gz->points[middle].out <= off) {
+      left = middle;
+    } else {
+      right = middle - 1;
+    }
+  }
+  Point p = gz->points[left];
+  // Inflate up to the next checkpoint, or past the last one to everything
+  // inflated so far, so neighbouring rows hit this span.
+  size_t end = left + 1 < gz->npoints ? gz->points[left + 1].out : gz->out;
+  pthread_mutex_unlock(&gz->lock);
+
+  if (end < off + len)
+    end = off + len;
+  inflate_span(gz, &p, lru, end);
+  lru->used = ++gz->tick;
+  return &lru->data[off - lru->start];
+}
+
+void gz_close(Loggy *l) {
+  Gz *gz = l->gz;
+  if (gz == NULL)
+    return;
+  for (int i = 0; i < gz->npoints; i++)
+    free(gz->points[i].window);
+  free(gz->points);
+  for (int i = 0; i < NSPANS; i++)
+    free(gz->spans[i].data);
+  pthread_mutex_destroy(&gz->lock);
+  munmap((void *)gz->map, gz->size);
+  free(gz);
+  l->gz = NULL;
+}
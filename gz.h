@@ -0,0 +1,10 @@
+#ifndef GZ_H_
+#define GZ_H_
+
+#include "loggy.h"
+
+bool gz_open(Loggy *l, int fd);
+char *gz_data(Loggy *l, size_t off, size_t len);
+void gz_close(Loggy *l);
+
+#endif // GZ_H_
@@ -0,0 +1,84 @@
+#include "highlight.h"
+#include "common.h"
+#include "loggy.h"
+#include "scan.h"
+#include <stdlib.h>
+
+// Rows whose highlights are remembered, indexed by row number. Comfortably
+// more than a screenful, so scrolling by a line or a page mostly hits.
+#define HIGHLIGHT_CACHE 256
+
+// Matches of the current pattern in one row, found when the row was last
+// drawn. generation and version say which pattern and which numbering of
+// the rows they belong to.
+typedef struct {
+  int row;
+  int generation;
+  int version;
+  regmatch_t *spans;
+  int len;
+  int capacity;
+} HighlightEntry;
+
+struct Highlights {
+  HighlightEntry entries[HIGHLIGHT_CACHE];
+};
+
+static void entry_append(HighlightEntry *e, regmatch_t span) {
+  if (e->len == e->capacity) {
+    e->capacity = e->capacity ? e->capacity * 2 : 4;
+    e->spans = realloc(e->spans, sizeof(regmatch_t) * e->capacity);
+    if (e->spans == NULL) {
+      die("realloc");
+    }
+  }
+  e->spans[e->len++] = span;
+}
+
+// Finds the non-empty matches of the current pattern in row.
+static void find_spans(Loggy *l, int row, HighlightEntry *e) {
+  Matches *m = &l->matches;
+  e->len = 0;
+
+  const char *data = row_data(l, row);
+  regoff_t len = l->rows[row].len;
+  if (m->literallen > 0 && !scan_substr(data, len, m->literal, m->literallen))
+    return;
+
+  regoff_t off = 0;
+  regmatch_t match;
+  while (off <= len && matcher_exec(&m->matcher, data, len, off, &match)) {
+    if (match.rm_eo > match.rm_so)
+      entry_append(e, match);
+    off = match.rm_eo > match.rm_so ? match.rm_eo : match.rm_eo + 1;
+  }
+}
+
+// Returns the spans of row to show highlighted, in order. They are worked
+// out the first time a row is drawn and kept until the pattern changes, so
+// the cost follows what is on screen rather than the size of the file.
+int highlight_row(Loggy *l, int row, const regmatch_t **spans) {
+  Matches *m = &l->matches;
+  if (m->pattern == NULL)
+    return 0;
+
+  if (l->highlights == NULL) {
+    l->highlights = calloc(1, sizeof(Highlights));
+    if (l->highlights == NULL) {
+      die("calloc");
+    }
+    for (int i = 0; i < HIGHLIGHT_CACHE; i++)
+      l->highlights->entries[i].row = -1;
+  }
+
+  HighlightEntry *e = &l->highlights->entries[row % HIGHLIGHT_CACHE];
+  if (e->row != row || e->generation != l->pool.generation ||
+      e->version != m->version) {
+    find_spans(l, row, e);
+    e->row = row;
+    e->generation = l->pool.generation;
+    e->version = m->version;
+  }
+  *spans = e->spans;
+  return e->len;
+}
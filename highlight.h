@@ -0,0 +1,8 @@
+#ifndef HIGHLIGHT_H_
+#define HIGHLIGHT_H_
+
+#include "loggy.h"
+
+int highlight_row(Loggy *l, int row, const regmatch_t **spans);
+
+#endif // HIGHLIGHT_H_
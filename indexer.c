@@ -0,0 +1,210 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include "indexer.h"
+#include "cache.h"
+#include "common.h"
+#include "events.h"
+#include "loggy.h"
+#include "scan.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bytes scanned between publishes. Small enough that the first screenful
+// shows up almost immediately, large enough to keep lock traffic negligible.
+#define INDEX_CHUNK (1 << 20)
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+void indexer_publish(Indexer *idx, Row *rows, int nrows, int ncols,
+                     size_t scanned) {
+  pthread_mutex_lock(&idx->lock);
+  if (idx->npending + nrows > idx->capacity) {
+    int capacity = idx->capacity ? idx->capacity : 1024;
+    while (capacity < idx->npending + nrows)
+      capacity *= 2;
+    Row *new = realloc(idx->pending, sizeof(Row) * capacity);
+    if (new == NULL) {
+      die("realloc");
+    }
+    idx->pending = new;
+    idx->capacity = capacity;
+  }
+  memcpy(&idx->pending[idx->npending], rows, sizeof(Row) * nrows);
+  idx->npending += nrows;
+  if (ncols > idx->ncols)
+    idx->ncols = ncols;
+  idx->scanned = scanned;
+  pthread_mutex_unlock(&idx->lock);
+  events_wake(idx->wake);
+}
+
+// Tells the main thread that the indexing thread is done.
+void indexer_finish(Indexer *idx) {
+  pthread_mutex_lock(&idx->lock);
+  idx->done = true;
+  pthread_mutex_unlock(&idx->lock);
+  events_wake(idx->wake);
+}
+
+// Length of the line data[start, end) without trailing carriage returns.
+static size_t line_len(const char *data, size_t start, size_t end) {
+  size_t len = end - start;
+  while (len > 0 && data[start + len - 1] == '\r')
+    len--;
+  return len;
+}
+
+bool indexer_should_stop(Indexer *idx) {
+  pthread_mutex_lock(&idx->lock);
+  bool stop = idx->stop;
+  pthread_mutex_unlock(&idx->lock);
+  return stop;
+}
+
+static void *index_thread(void *arg) {
+  Indexer *idx = arg;
+  const char *data = idx->data;
+  size_t size = idx->size;
+
+  Row *batch = NULL;
+  int nbatch = 0, capacity = 0, ncols = 0;
+  size_t nl[4096];
+
+  size_t start = idx->from;
+  size_t pos = idx->from;
+  while (pos < size && !indexer_should_stop(idx)) {
+    size_t end = pos + INDEX_CHUNK < size ? pos + INDEX_CHUNK : size;
+
+    while (pos < end) {
+      size_t n = scan_newlines(data, pos, end, nl, ARRAY_SIZE(nl));
+      if (nbatch + (int)n > capacity) {
+        while (nbatch + (int)n > capacity)
+          capacity = capacity ? capacity * 2 : 1024;
+        batch = realloc(batch, sizeof(Row) * capacity);
+        if (batch == NULL) {
+          die("realloc");
+        }
+      }
+
+      for (size_t i = 0; i < n; i++) {
+        size_t len = line_len(data, start, nl[i]);
+        batch[nbatch++] = (Row){.off = start, .len = len};
+        if ((int)len > ncols)
+          ncols = len;
+        start = nl[i] + 1;
+      }
+
+      pos = n < ARRAY_SIZE(nl) ? end : start;
+    }
+
+    indexer_publish(idx, batch, nbatch, ncols, pos);
+    nbatch = 0;
+  }
+
+  // A final line without a trailing newline.
+  if (start < size && pos >= size) {
+    size_t len = line_len(data, start, size);
+    Row last = {.off = start, .len = len};
+    indexer_publish(idx, &last, 1, (int)len > ncols ? (int)len : ncols, size);
+  }
+
+  free(batch);
+
+  indexer_finish(idx);
+  return NULL;
+}
+
+void indexer_start(Loggy *l, size_t from) {
+  Indexer *idx = &l->indexer;
+  *idx = (Indexer){.data = l->data,
+                   .size = l->size,
+                   .from = from,
+                   .scanned = from,
+                   .progress = from,
+                   .wake = l->events.wakefd,
+                   .running = true};
+  pthread_mutex_init(&idx->lock, NULL);
+
+  if (pthread_create(&idx->thread, NULL, index_thread, idx) != 0) {
+    die("pthread_create");
+  }
+}
+
+// Moves rows published by the indexing thread into the row table. Returns
+// true if anything visible changed since the last call: rows were added,
+// the progress in the status bar moved or indexing finished.
+bool indexer_poll(Loggy *l) {
+  Indexer *idx = &l->indexer;
+  if (!idx->running)
+    return false;
+
+  pthread_mutex_lock(&idx->lock);
+  Row *pending = idx->pending;
+  int npending = idx->npending;
+  idx->pending = NULL;
+  idx->npending = 0;
+  idx->capacity = 0;
+  if (idx->ncols > l->ncols)
+    l->ncols = idx->ncols;
+  bool moved = l->size > 0 &&
+               idx->scanned * 100 / l->size != idx->progress * 100 / l->size;
+  idx->progress = idx->scanned;
+  bool done = idx->done;
+  pthread_mutex_unlock(&idx->lock);
+
+  if (npending > 0) {
+    rows_reserve(l, npending);
+    memcpy(&l->rows[l->nrows], pending, sizeof(Row) * npending);
+    l->nrows += npending;
+  }
+  free(pending);
+
+  if (done) {
+    indexer_stop(l);
+    cache_save(l);
+  }
+  return npending > 0 || moved || done;
+}
+
+void indexer_stop(Loggy *l) {
+  Indexer *idx = &l->indexer;
+  if (!idx->running)
+    return;
+
+  pthread_mutex_lock(&idx->lock);
+  idx->stop = true;
+  pthread_mutex_unlock(&idx->lock);
+
+  pthread_join(idx->thread, NULL);
+  pthread_mutex_destroy(&idx->lock);
+  free(idx->pending);
+  idx->pending = NULL;
+  idx->npending = 0;
+  idx->running = false;
+}
+
+// Indexes l->data[from, l->size) on the calling thread and appends the rows
+// directly. Used for bytes appended after the initial scan has finished.
+void indexer_extend(Loggy *l, size_t from) {
+  assert(!l->indexer.running);
+
+  size_t nl[4096];
+  size_t start = from;
+  while (start < l->size) {
+    size_t n = scan_newlines(l->data, start, l->size, nl, ARRAY_SIZE(nl));
+    rows_reserve(l, n);
+    for (size_t i = 0; i < n; i++) {
+      row_append_view(l, start, line_len(l->data, start, nl[i]));
+      start = nl[i] + 1;
+    }
+    if (n < ARRAY_SIZE(nl))
+      break;
+  }
+
+  if (start < l->size) {
+    row_append_view(l, start, line_len(l->data, start, l->size));
+  }
+}
@@ -0,0 +1,15 @@
+#ifndef INDEXER_H_
+#define INDEXER_H_
+
+#include "loggy.h"
+
+void indexer_start(Loggy *l, size_t from);
+bool indexer_poll(Loggy *l);
+void indexer_stop(Loggy *l);
+void indexer_extend(Loggy *l, size_t from);
+void indexer_publish(Indexer *idx, Row *rows, int nrows, int ncols,
+                     size_t scanned);
+bool indexer_should_stop(Indexer *idx);
+void indexer_finish(Indexer *idx);
+
+#endif // INDEXER_H_
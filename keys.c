@@ -1,27 +1,162 @@
+#define _DEFAULT_SOURCE
+
 #include "keys.h"
 #include "common.h"
+#include "filter.h"
+#include "follow.h"
+#include "keywords.h"
 #include "loggy.h"
+#include "matchlist.h"
+#include "merge.h"
+#include "search.h"
+#include "timestamp.h"
 #include <errno.h>
-#include <regex.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+// Returns '\0' if no key is waiting. The main loop polls the tty first, so
+// this never has to wait.
 char read_key() {
-  int nread;
   char buf;
+  int nread = read(STDIN_FILENO, &buf, 1);
+  if (nread == -1 && errno != EAGAIN && errno != EINTR)
+    die("read");
+  return nread == 1 ? buf : '\0';
+}
+
+// Moves the cursor to view position cy, clamped to the rows there are.
+static void goto_row(Loggy *l, long long cy) {
+  int len = view_len(l);
+  if (cy >= len)
+    cy = len - 1;
+  if (cy < 0)
+    cy = 0;
+  l->cy = cy;
+}
+
+// Moves the cursor as G or Ngg do for count, or N% does if c is '%'. Until
+// the merge has the row, the jump is left waiting for jump_poll.
+static void jump(Loggy *l, char c, int count) {
+  long long rows = c == '%' || count == 0 ? INT_MAX : count;
+  merge_want(l, rows);
+  l->jump = '\0';
+  if (!merge_has(l, rows)) {
+    l->jump = c;
+    l->jump_count = count;
+    return;
+  }
+  if (c == '%') {
+    goto_row(l, ((long long)count * view_len(l) + 99) / 100 - 1);
+  } else {
+    goto_row(l, count ? count - 1 : view_len(l) - 1);
+  }
+}
+
+// Makes the jump left waiting once the merge has reached its row. Returns
+// true if the cursor moved.
+bool jump_poll(Loggy *l) {
+  if (l->jump == '\0')
+    return false;
+  jump(l, l->jump, l->jump_count);
+  return l->jump == '\0';
+}
 
-  while ((nread = read(STDIN_FILENO, &buf, 1)) != 1) {
-    if (nread == -1 && errno != EAGAIN)
-      die("read");
+// Scrolls the view and the cursor together, as vi does for Ctrl-D/U and
+// Ctrl-F/B.
+static void scroll_rows(Loggy *l, long long delta) {
+  long long last = view_len(l) - l->c.rows;
+  long long rowoff = l->rowoff + delta;
+  if (rowoff > last)
+    rowoff = last;
+  if (rowoff < 0)
+    rowoff = 0;
+  l->rowoff = rowoff;
+  goto_row(l, l->cy + delta);
+}
+
+// Moves the cursor n matches forward or back from where it is, wrapping
+// around the ends. Takes two lookups however many matches there are.
+static void goto_match(Loggy *l, int n, bool forward) {
+  MatchList *list = &l->matches.list;
+  if (list->len == 0 || l->cy >= view_len(l))
+    return;
+
+  // The first match after the cursor, or the last one before it.
+  int row = view_row(l, l->cy);
+  long long i = forward ? matchlist_find(list, row, l->cx + 1) + (n - 1)
+                        : matchlist_find(list, row, l->cx) - 1 - (n - 1);
+  if (i < 0 || i >= list->len) {
+    write_status_message(l, "Search wrapped to the %s",
+                         forward ? "top" : "bottom");
+  } else {
+    clear_status_message(l);
   }
+  i = (i % list->len + list->len) % list->len;
 
-  return buf;
+  MatchCursor c;
+  int col;
+  matchlist_seek(list, i, &c);
+  matchlist_next(&c, &row, &col);
+  l->cy = view_find(l, row);
+  l->cx = col;
 }
 
-void process_key_normal(Loggy *l) {
+bool process_key_normal(Loggy *l) {
   char c = read_key();
+  if (c == '\0')
+    return false;
+  // Any key stops a jump that is still looking for a keyword or a match, or
+  // waiting for the merge.
+  keywords_cancel(l);
+  goto_time_cancel(l);
+  l->jump = '\0';
+  l->matches.preview = false;
 
+  // "]3" goes to the next occurrence of the third keyword and "]]" to the
+  // next of any, "[3" and "[[" to the previous ones.
+  if (l->pending == ']' || l->pending == '[') {
+    bool forward = l->pending == ']';
+    int n = l->count ? l->count : 1;
+    l->count = 0;
+    l->pending = '\0';
+    int keyword = -1;
+    if (c >= '1' && c <= '9') {
+      keyword = c - '1';
+    } else if (c != (forward ? ']' : '[')) {
+      return true;
+    }
+    if (!keywords_jump(l, keyword, forward, n))
+      write_status_message(l, "Keyword not found");
+    return true;
+  }
+
+  if ((c >= '1' && c <= '9') || (c == '0' && l->count > 0)) {
+    if (l->count < 100000000)
+      l->count = l->count * 10 + (c - '0');
+    return true;
+  }
+  int count = l->count;
+  char pending = l->pending;
+  l->count = 0;
+  l->pending = '\0';
+
+  if (pending == 'g') {
+    if (c == 'g') {
+      if (count) {
+        jump(l, 'G', count);
+      } else {
+        goto_row(l, 0);
+      }
+    }
+    return true;
+  }
+
+  int n = count ? count : 1;
+  int half = l->c.rows / 2 > 0 ? l->c.rows / 2 : 1;
+  int page = l->c.rows > 2 ? l->c.rows - 2 : 1;
   switch (c) {
   case CTRL_KEY('q'):
     write(STDOUT_FILENO, "\x1b[2J", 4);
@@ -29,25 +164,57 @@ void process_key_normal(Loggy *l) {
     exit(0);
     break;
   case 'h':
+    l->cx = l->cx > n ? l->cx - n : 0;
+    break;
+  case 'l':
+    if (l->ncols > 0)
+      l->cx = l->cx < l->ncols - n ? l->cx + n : l->ncols - 1;
+    break;
   case 'j':
+    goto_row(l, (long long)l->cy + n);
+    break;
   case 'k':
-  case 'l':
-  case 'n':
-    move_cursor(l, c);
+    goto_row(l, (long long)l->cy - n);
     break;
-  case 'G': {
-    int times = l->nrows - l->cy;
-    while (times > 0) {
-      move_cursor(l, 'j');
-      times--;
+  case 'n':
+  case 'N':
+    if (l->matches.count_only) {
+      write_status_message(l, "Matches are only being counted; press # first");
+      break;
     }
-  } break;
+    goto_match(l, n, (c == 'n') != l->matches.backward);
+    break;
+  case 'g':
+    l->count = count;
+    l->pending = 'g';
+    break;
+  case 'G':
+    jump(l, 'G', count);
+    break;
+  case '%':
+    if (count > 0 && count <= 100)
+      jump(l, '%', count);
+    break;
+  case CTRL_KEY('d'):
+    scroll_rows(l, count ? count : half);
+    break;
+  case CTRL_KEY('u'):
+    scroll_rows(l, -(count ? count : half));
+    break;
+  case CTRL_KEY('f'):
+    scroll_rows(l, (long long)n * page);
+    break;
+  case CTRL_KEY('b'):
+    scroll_rows(l, -(long long)n * page);
+    break;
   case '0':
     l->coloff = 0;
     l->cx = 0;
     break;
   case '$': {
-    int linelen = l->rows[l->rowoff + l->cy].len;
+    if (l->cy >= view_len(l))
+      break;
+    int linelen = l->rows[view_row(l, l->cy)].len;
     l->coloff = linelen - l->c.cols;
     if (l->coloff < 0)
       l->coloff = 0;
@@ -55,13 +222,49 @@ void process_key_normal(Loggy *l) {
     if (l->cx < 0)
       l->cx = 0;
   } break;
+  case 'F':
+    if (l->follow.enabled) {
+      follow_stop(l);
+    } else {
+      follow_start(l);
+    }
+    break;
+  case '&':
+    filter_toggle(l);
+    break;
+  case '#':
+    search_toggle_count(l);
+    break;
+  case CTRL_KEY('g'):
+    l->debug = !l->debug;
+    break;
+  case 't':
+    l->mode = TIME;
+    write_status_message(l, "@");
+    break;
+  case 'K':
+    l->mode = KEYWORD;
+    write_status_message(l, "+");
+    break;
+  case ']':
+  case '[':
+    l->count = count;
+    l->pending = c;
+    break;
   case '/':
+  case '?':
     l->mode = SEARCH;
-    write_status_message(l, "/");
+    l->matches.backward = c == '?';
+    l->matches.preview = true;
+    l->matches.jumped = false;
+    l->matches.origin_cx = l->cx;
+    l->matches.origin_cy = view_row(l, l->cy);
+    write_status_message(l, "%c", c);
     break;
   default:
     break;
   }
+  return true;
 }
 
 void move_cursor(Loggy *l, char key) {
@@ -72,7 +275,7 @@ void move_cursor(Loggy *l, char key) {
     }
     break;
   case 'j':
-    if (l->cy + 1 < l->nrows) {
+    if (l->cy + 1 < view_len(l)) {
       l->cy++;
     }
     break;
@@ -86,46 +289,126 @@ void move_cursor(Loggy *l, char key) {
       l->cx++;
     }
     break;
-  case 'n': {
-    Matches m = l->matches;
-    if (m.len == 0) {
-      break;
-    }
+  }
+}
 
-    Match cur_match;
-    int left = 0;
-    int right = m.len - 1;
-    while (left != right) {
-      int middle = (left + right) / 2;
-      cur_match = m.matches[middle];
-      if (cur_match.row <= l->cy) {
-        left = middle + 1;
-      } else {
-        right = middle;
-      }
-    }
+// Re-runs the search for what has been typed so far. Patterns that do not
+// compile yet, like an unfinished "\\(", leave the previous preview alone.
+static void search_preview(Loggy *l) {
+  Matches *m = &l->matches;
+  l->status_message.data[l->status_message.len] = '\0';
+  const char *pattern = &l->status_message.data[1];
 
-    for (; left > 0; left--) {
-      Match cur = m.matches[left];
-      Match prev = m.matches[left - 1];
+  if (*pattern == '\0') {
+    search_stop(l);
+  } else if (m->pattern && strcmp(m->pattern, pattern) == 0) {
+    return;
+  } else if (!search_start(l, pattern)) {
+    return;
+  }
 
-      if (prev.row < l->cy ||
-          (prev.row == l->cy && prev.regmatch.rm_so <= l->cx)) {
-        l->cy = cur.row;
-        l->cx = cur.regmatch.rm_so;
-        break;
-      }
+  l->cx = m->origin_cx;
+  l->cy = view_find(l, m->origin_cy);
+  m->jumped = false;
+}
+
+bool process_key_search(Loggy *l) {
+  char c = read_key();
+  if (c == '\0')
+    return false;
+
+  switch (c) {
+  case 0x1b:
+    l->mode = NORMAL;
+    l->matches.preview = false;
+    l->cx = l->matches.origin_cx;
+    l->cy = view_find(l, l->matches.origin_cy);
+    search_stop(l);
+    clear_status_message(l);
+    break;
+  case 0xd:
+    // The preview jump is kept until it happens: if the pattern and Enter
+    // came in one burst, no search step has run yet.
+    l->mode = NORMAL;
+    l->status_message.data[l->status_message.len] = '\0';
+    if (l->status_message.len > 1 &&
+        !search_start(l, &l->status_message.data[1])) {
+      l->matches.preview = false;
+      // The pattern lives in the status message buffer itself.
+      char *pattern = strdup(&l->status_message.data[1]);
+      write_status_message(l, "Invalid pattern: %s", pattern);
+      free(pattern);
+    } else {
+      clear_status_message(l);
+    }
+    break;
+  case 127:
+  case CTRL_KEY('h'):
+    if (l->status_message.len <= 1) {
+      l->mode = NORMAL;
+      l->matches.preview = false;
+      search_stop(l);
+      clear_status_message(l);
+      break;
     }
-    Match cur = m.matches[left];
-    l->cy = cur.row;
-    l->cx = cur.regmatch.rm_so;
+    l->status_message.len--;
+    search_preview(l);
+    break;
+  default:
+    if (l->status_message.len + 1 > l->c.cols) {
+      break;
+    }
+    l->status_message.data[l->status_message.len++] = c;
+    search_preview(l);
+    break;
+  }
+  return true;
+}
 
+bool process_key_time(Loggy *l) {
+  char c = read_key();
+  if (c == '\0')
+    return false;
+
+  switch (c) {
+  case 0x1b:
+    l->mode = NORMAL;
+    clear_status_message(l);
+    break;
+  case 0xd: {
+    l->mode = NORMAL;
+    l->status_message.data[l->status_message.len] = '\0';
+    // goto_time may report through the status message buffer.
+    char *when = strdup(&l->status_message.data[1]);
+    clear_status_message(l);
+    if (*when != '\0' && !goto_time(l, when))
+      write_status_message(l, "Invalid time: %s", when);
+    free(when);
   } break;
+  case 127:
+  case CTRL_KEY('h'):
+    if (l->status_message.len <= 1) {
+      l->mode = NORMAL;
+      clear_status_message(l);
+      break;
+    }
+    l->status_message.len--;
+    break;
+  default:
+    if (l->status_message.len + 1 > l->c.cols) {
+      break;
+    }
+    l->status_message.data[l->status_message.len++] = c;
+    break;
   }
+  return true;
 }
 
-void process_key_search(Loggy *l) {
+// Adds the keyword typed after '+'; an empty one clears them all.
+bool process_key_keyword(Loggy *l) {
   char c = read_key();
+  if (c == '\0')
+    return false;
 
   switch (c) {
   case 0x1b:
@@ -134,14 +417,27 @@ void process_key_search(Loggy *l) {
     break;
   case 0xd: {
     l->mode = NORMAL;
-    int flags = 0;
-    regex_t search_regex;
-    if (regcomp(&search_regex, &l->status_message.data[1], flags)) {
-      die("regcomp");
-    }
-    find(l, search_regex);
+    l->status_message.data[l->status_message.len] = '\0';
+    char *word = strdup(&l->status_message.data[1]);
     clear_status_message(l);
+    if (*word == '\0') {
+      keywords_clear(l);
+      write_status_message(l, "Keywords cleared");
+    } else {
+      keywords_add(l, word);
+      write_status_message(l, "Keyword %d: %s", keywords_count(l), word);
+    }
+    free(word);
   } break;
+  case 127:
+  case CTRL_KEY('h'):
+    if (l->status_message.len <= 1) {
+      l->mode = NORMAL;
+      clear_status_message(l);
+      break;
+    }
+    l->status_message.len--;
+    break;
   default:
     if (l->status_message.len + 1 > l->c.cols) {
       break;
@@ -149,4 +445,21 @@ void process_key_search(Loggy *l) {
     l->status_message.data[l->status_message.len++] = c;
     break;
   }
+  return true;
+}
+
+// Handles the next key, if one is waiting, in the current mode. Returns
+// false if there was none.
+bool process_key(Loggy *l) {
+  switch (l->mode) {
+  case NORMAL:
+    return process_key_normal(l);
+  case SEARCH:
+    return process_key_search(l);
+  case TIME:
+    return process_key_time(l);
+  case KEYWORD:
+    return process_key_keyword(l);
+  }
+  return false;
 }
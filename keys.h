@@ -3,6 +3,10 @@
 #define CTRL_KEY(k) ((k)&0x1f)
 
 char read_key();
-void process_key_normal(Loggy *l);
-void process_key_search(Loggy *l);
+bool process_key(Loggy *l);
+bool process_key_normal(Loggy *l);
+bool process_key_search(Loggy *l);
+bool process_key_time(Loggy *l);
+bool process_key_keyword(Loggy *l);
 void move_cursor(Loggy *l, char key);
+bool jump_poll(Loggy *l);
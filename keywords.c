@@ -0,0 +1,352 @@
+#define _DEFAULT_SOURCE
+
+#include "keywords.h"
+#include "common.h"
+#include "filter.h"
+#include "loggy.h"
+#include "merge.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Colors given to keywords in the order they were added.
+static const int colors[] = {31, 32, 33, 35, 36, 34, 91, 92, 93, 95, 96, 94};
+
+#define NCOLORS (int)(sizeof(colors) / sizeof(colors[0]))
+// Rows looked at per call to keywords_step.
+#define KEYWORD_STEP 16384
+
+// A jump to a keyword under way: left more occurrences to pass, looking on
+// from column col of view position pos. seen counts the rows looked at
+// since the last occurrence. waiting is set at an end of the view while
+// rows are still being added to it.
+typedef struct {
+  bool running;
+  bool waiting;
+  int keyword;
+  bool forward;
+  int left;
+  int pos;
+  int col;
+  int seen;
+} Jump;
+
+// Literal words to watch for, all found in one pass over a row with an
+// Aho-Corasick automaton. It is built as a DFA: next holds a transition for
+// every state and byte class, with the failure links already followed.
+// out is the longest word ending in a state, and link the next state along
+// the failure chain that also ends a word, so every word ending at a
+// position is reported.
+struct Keywords {
+  char **words;
+  int *lens;
+  int nwords;
+
+  uint8_t classes[256];
+  int nclasses;
+  int *next;
+  int *out;
+  int *link;
+  int nstates;
+
+  // Every occurrence in the row being looked at, and the non-overlapping
+  // ones drawn.
+  KeywordSpan *found;
+  int nfound, foundcap;
+  KeywordSpan *spans;
+  int nspans, spancap;
+
+  Jump jump;
+};
+
+static void build(Keywords *k) {
+  // Bytes in no word share class 0.
+  memset(k->classes, 0, sizeof(k->classes));
+  k->nclasses = 1;
+  int total = 1;
+  for (int w = 0; w < k->nwords; w++) {
+    for (int i = 0; i < k->lens[w]; i++) {
+      uint8_t c = k->words[w][i];
+      if (k->classes[c] == 0)
+        k->classes[c] = k->nclasses++;
+    }
+    total += k->lens[w];
+  }
+
+  free(k->next);
+  free(k->out);
+  free(k->link);
+  k->next = malloc(sizeof(int) * total * k->nclasses);
+  k->out = malloc(sizeof(int) * total);
+  k->link = malloc(sizeof(int) * total);
+  int *fail = malloc(sizeof(int) * total);
+  int *queue = malloc(sizeof(int) * total);
+  if (k->next == NULL || k->out == NULL || k->link == NULL || fail == NULL ||
+      queue == NULL) {
+    die("malloc");
+  }
+  memset(k->next, -1, sizeof(int) * total * k->nclasses);
+
+  // The trie.
+  k->nstates = 1;
+  k->out[0] = -1;
+  for (int w = 0; w < k->nwords; w++) {
+    int s = 0;
+    for (int i = 0; i < k->lens[w]; i++) {
+      int *t = &k->next[s * k->nclasses + k->classes[(uint8_t)k->words[w][i]]];
+      if (*t < 0) {
+        *t = k->nstates;
+        k->out[k->nstates++] = -1;
+      }
+      s = *t;
+    }
+    if (k->out[s] < 0 || k->lens[k->out[s]] < k->lens[w])
+      k->out[s] = w;
+  }
+
+  // Failure links breadth first, filling in the missing transitions from
+  // the state each one fails to.
+  int head = 0, tail = 0;
+  for (int c = 0; c < k->nclasses; c++) {
+    int *t = &k->next[c];
+    if (*t < 0) {
+      *t = 0;
+    } else {
+      fail[*t] = 0;
+      k->link[*t] = -1;
+      queue[tail++] = *t;
+    }
+  }
+  k->link[0] = -1;
+  while (head < tail) {
+    int s = queue[head++];
+    for (int c = 0; c < k->nclasses; c++) {
+      int *t = &k->next[s * k->nclasses + c];
+      int f = k->next[fail[s] * k->nclasses + c];
+      if (*t < 0) {
+        *t = f;
+        continue;
+      }
+      fail[*t] = f;
+      k->link[*t] = k->out[f] >= 0 ? f : k->link[f];
+      queue[tail++] = *t;
+    }
+  }
+  free(fail);
+  free(queue);
+}
+
+static void span_append(KeywordSpan **spans, int *n, int *capacity,
+                        KeywordSpan span) {
+  if (*n == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 16;
+    *spans = realloc(*spans, sizeof(KeywordSpan) * *capacity);
+    if (*spans == NULL) {
+      die("realloc");
+    }
+  }
+  (*spans)[(*n)++] = span;
+}
+
+// Finds every occurrence of every word in s, in order of where they end.
+static void scan(Keywords *k, const char *s, int len) {
+  k->nfound = 0;
+  int st = 0;
+  for (int i = 0; i < len; i++) {
+    st = k->next[st * k->nclasses + k->classes[(uint8_t)s[i]]];
+    for (int o = k->out[st] >= 0 ? st : k->link[st]; o >= 0; o = k->link[o]) {
+      int w = k->out[o];
+      KeywordSpan span = {i + 1 - k->lens[w], i + 1, w, colors[w % NCOLORS]};
+      span_append(&k->found, &k->nfound, &k->foundcap, span);
+    }
+  }
+}
+
+static int compare_spans(const void *a, const void *b) {
+  const KeywordSpan *x = a, *y = b;
+  if (x->so != y->so)
+    return x->so - y->so;
+  return y->eo - x->eo;
+}
+
+void keywords_add(Loggy *l, const char *word) {
+  if (*word == '\0')
+    return;
+  if (l->keywords == NULL) {
+    l->keywords = calloc(1, sizeof(Keywords));
+    if (l->keywords == NULL) {
+      die("calloc");
+    }
+  }
+
+  Keywords *k = l->keywords;
+  k->words = realloc(k->words, sizeof(char *) * (k->nwords + 1));
+  k->lens = realloc(k->lens, sizeof(int) * (k->nwords + 1));
+  if (k->words == NULL || k->lens == NULL) {
+    die("realloc");
+  }
+  k->words[k->nwords] = strdup(word);
+  k->lens[k->nwords++] = strlen(word);
+  build(k);
+}
+
+void keywords_clear(Loggy *l) {
+  Keywords *k = l->keywords;
+  if (k == NULL)
+    return;
+  for (int i = 0; i < k->nwords; i++)
+    free(k->words[i]);
+  k->nwords = 0;
+  build(k);
+}
+
+int keywords_count(Loggy *l) { return l->keywords ? l->keywords->nwords : 0; }
+
+// Returns the keywords to color in row, in order and not overlapping: where
+// several start at the same place, the longest wins.
+int keywords_row(Loggy *l, int row, const KeywordSpan **spans) {
+  Keywords *k = l->keywords;
+  if (k == NULL || k->nwords == 0)
+    return 0;
+
+  scan(k, row_data(l, row), l->rows[row].len);
+  qsort(k->found, k->nfound, sizeof(KeywordSpan), compare_spans);
+  k->nspans = 0;
+  int end = 0;
+  for (int i = 0; i < k->nfound; i++) {
+    if (k->found[i].so >= end) {
+      span_append(&k->spans, &k->nspans, &k->spancap, k->found[i]);
+      end = k->found[i].eo;
+    }
+  }
+  *spans = k->spans;
+  return k->nspans;
+}
+
+// Returns the column of the first occurrence of keyword (any keyword if
+// negative) in row after column col when going forward, or the last one
+// before it going back. -1 if there is none.
+static int find_in_row(Loggy *l, int row, int keyword, int col, bool forward) {
+  Keywords *k = l->keywords;
+  scan(k, row_data(l, row), l->rows[row].len);
+  int best = -1;
+  for (int i = 0; i < k->nfound; i++) {
+    KeywordSpan *f = &k->found[i];
+    if (keyword >= 0 && f->keyword != keyword)
+      continue;
+    if (forward && f->so > col && (best < 0 || f->so < best))
+      best = f->so;
+    if (!forward && f->so < col && f->so > best)
+      best = f->so;
+  }
+  return best;
+}
+
+// Starts moving the cursor n occurrences of keyword on, or of any keyword
+// if it is negative, going forward or back and wrapping around the ends of
+// the view. Rows are scanned as they are reached, a slice at a time by
+// keywords_step, so nothing is indexed up front and a key press can stop
+// it. Returns false if there are no keywords to look for.
+bool keywords_jump(Loggy *l, int keyword, bool forward, int n) {
+  Keywords *k = l->keywords;
+  int len = view_len(l);
+  if (keywords_count(l) == 0 || len == 0 || keyword >= keywords_count(l))
+    return false;
+
+  k->jump = (Jump){.running = true,
+                   .keyword = keyword,
+                   .forward = forward,
+                   .left = n,
+                   .pos = l->cy < len ? l->cy : len - 1,
+                   .col = l->cx};
+  keywords_step(l);
+  if (k->jump.running)
+    write_status_message(l, "Looking for %s...",
+                         keyword < 0 ? "keywords" : k->words[keyword]);
+  return true;
+}
+
+// Whether more rows may yet be added to the end of the view. A merge is
+// asked for the rest of its rows.
+static bool growing(Loggy *l) {
+  if (l->indexer.running)
+    return true;
+  if (!merge_done(l)) {
+    merge_want(l, INT_MAX);
+    return true;
+  }
+  return false;
+}
+
+// Looks through up to KEYWORD_STEP rows for the jump under way. Returns true
+// if it finished.
+bool keywords_step(Loggy *l) {
+  Keywords *k = l->keywords;
+  if (k == NULL || !k->jump.running)
+    return false;
+
+  Jump *j = &k->jump;
+  j->waiting = false;
+  for (int budget = KEYWORD_STEP; budget > 0; budget--) {
+    int len = view_len(l);
+    if (len == 0) {
+      j->running = false;
+      write_status_message(l, "Keyword not found");
+      return true;
+    }
+    if (j->pos >= len)
+      j->pos = len - 1;
+    int row = view_row(l, j->pos);
+    int found = find_in_row(l, row, j->keyword, j->col, j->forward);
+    if (found >= 0) {
+      j->seen = 0;
+      j->col = found;
+      if (--j->left > 0)
+        continue;
+      j->running = false;
+      l->cy = j->pos;
+      l->cx = found;
+      clear_status_message(l);
+      return true;
+    }
+
+    // Every row has been looked at since the last occurrence, so there
+    // are none.
+    if (++j->seen > len) {
+      j->running = false;
+      write_status_message(l, "Keyword not found");
+      return true;
+    }
+    bool end = j->forward ? j->pos == len - 1 : j->pos == 0;
+    // Wrap around only once the view is complete.
+    if (end && growing(l)) {
+      j->seen--;
+      j->waiting = true;
+      return false;
+    }
+    if (j->forward) {
+      j->pos = end ? 0 : j->pos + 1;
+      j->col = -1;
+    } else {
+      j->pos = end ? len - 1 : j->pos - 1;
+      j->col = l->rows[view_row(l, j->pos)].len + 1;
+    }
+  }
+  return false;
+}
+
+// Whether a jump has rows left to look at now.
+bool keywords_busy(Loggy *l) {
+  return l->keywords && l->keywords->jump.running &&
+         !l->keywords->jump.waiting;
+}
+
+// Stops the jump under way, if there is one. Returns true if there was.
+bool keywords_cancel(Loggy *l) {
+  Keywords *k = l->keywords;
+  if (k == NULL || !k->jump.running)
+    return false;
+  k->jump.running = false;
+  clear_status_message(l);
+  return true;
+}
@@ -0,0 +1,23 @@
+#ifndef KEYWORDS_H_
+#define KEYWORDS_H_
+
+#include "loggy.h"
+
+// Where keyword number keyword was found in a row, and the SGR color code
+// it is drawn in.
+typedef struct {
+  int so, eo;
+  int keyword;
+  int color;
+} KeywordSpan;
+
+void keywords_add(Loggy *l, const char *word);
+void keywords_clear(Loggy *l);
+int keywords_count(Loggy *l);
+int keywords_row(Loggy *l, int row, const KeywordSpan **spans);
+bool keywords_jump(Loggy *l, int keyword, bool forward, int n);
+bool keywords_step(Loggy *l);
+bool keywords_busy(Loggy *l);
+bool keywords_cancel(Loggy *l);
+
+#endif // KEYWORDS_H_
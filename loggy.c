@@ -3,17 +3,32 @@
 #define _BSD_SOURCE
 #define _GNU_SOURCE
 
+#include "cache.h"
 #include "common.h"
+#include "events.h"
+#include "filter.h"
+#include "follow.h"
+#include "gz.h"
+#include "highlight.h"
+#include "keywords.h"
+#include "indexer.h"
+#include "merge.h"
 #include "keys.h"
 #include "loggy.h"
+#include "scan.h"
+#include "search.h"
+#include "stream.h"
 #include "thirdparty/cJSON.h"
 #include <assert.h>
 #include <ctype.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <fcntl.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <termios.h>
 #include <unistd.h>
 
@@ -26,17 +41,50 @@ void init(Loggy *l) {
     die("get_window_size");
   }
   l->c.rows -= 2;
+  l->c.time_formats = NULL;
+  l->c.ntime_formats = 0;
+  l->c.stream_buffer = (size_t)256 << 20;
+  l->c.frame_interval = 16;
+  l->c.matcher = NULL;
 
   enable_raw_mode();
-
-  l->matches = (Matches){.matches = NULL, .len = 0, .cur = 0};
-
-  char status_buffer[l->c.cols];
-  l->status_message = (Buffer){.len = 0, .data = malloc(sizeof(status_buffer))};
+  scan_init();
+
+  events_init(l);
+  l->matches = (Matches){.pattern = NULL, .count_only = false};
+  search_pool_start(l);
+  l->highlights = NULL;
+  l->keywords = NULL;
+
+  // One extra byte so a pattern typed after '/' can be NUL-terminated.
+  char status_buffer[l->c.cols + 1];
+  l->status_message = (Buffer){.len = 0,
+                               .data = malloc(sizeof(status_buffer)),
+                               .capacity = sizeof(status_buffer)};
   l->mode = NORMAL;
+  l->count = 0;
+  l->pending = '\0';
+  l->jump = '\0';
 
   l->filename = NULL;
+  l->data = NULL;
+  l->size = 0;
+  l->mapped = false;
+  l->arena = (Arena){0};
+  l->gz = NULL;
+  l->merge = NULL;
+  l->pending_time = NULL;
+  l->indexer.running = false;
+  l->follow.enabled = false;
+  l->stream = (Stream){.enabled = false, .fd = -1};
+  l->filter = (Filter){.enabled = false, .rows = NULL, .len = 0};
+  l->frame = (Frame){.lines = NULL, .next = NULL, .nlines = 0};
+  l->out = (Buffer){.len = 0, .data = NULL, .capacity = 0};
+  l->debug = false;
   l->rows = NULL;
+  l->rowcap = 0;
+  l->evicted = 0;
+  l->cache = (IndexCache){0};
   l->cx = 0;
   l->cy = 0;
   l->rowoff = 0;
@@ -48,21 +96,28 @@ void init(Loggy *l) {
 }
 
 void parse_config(Loggy *l, char *path) {
-  char error[80];
   FILE *fp = fopen(path, "r");
   if (!fp) {
     write_status_message(l, "Error opening config file.");
     return;
   }
-  char buffer[1024];
-  fread(buffer, ARRAY_SIZE(buffer), sizeof(*buffer), fp);
+  // Read all of it: the keyword and time format lists can make it long.
+  Buffer text = {0};
+  char chunk[4096];
+  size_t len;
+  while ((len = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    buf_append(&text, chunk, len);
   if (ferror(fp)) {
     write_status_message(l, "Error reading config file");
+    fclose(fp);
+    free(text.data);
     return;
   }
+  fclose(fp);
+  buf_append(&text, "", 1);
 
-  const char **parse_end;
-  cJSON *config = cJSON_Parse(buffer);
+  cJSON *config = cJSON_Parse(text.data);
+  free(text.data);
   if (config == NULL) {
     const char *error_ptr = cJSON_GetErrorPtr();
     if (error_ptr != NULL) {
@@ -71,12 +126,42 @@ void parse_config(Loggy *l, char *path) {
     return;
   }
 
-  cJSON *element;
-  cJSON_ArrayForEach(element, config) {
-    int len = snprintf(error, sizeof(error), "Name: %s Value: %s",
-                       element->string, element->valuestring);
-    l->status_message.data = error;
-    l->status_message.len = len;
+  cJSON *formats = cJSON_GetObjectItemCaseSensitive(config, "time_formats");
+  if (cJSON_IsArray(formats)) {
+    l->c.time_formats = malloc(cJSON_GetArraySize(formats) * sizeof(char *));
+    cJSON *element;
+    cJSON_ArrayForEach(element, formats) {
+      if (cJSON_IsString(element)) {
+        l->c.time_formats[l->c.ntime_formats++] =
+            strdup(element->valuestring);
+      }
+    }
+  }
+
+  cJSON *interval =
+      cJSON_GetObjectItemCaseSensitive(config, "frame_interval_ms");
+  if (cJSON_IsNumber(interval) && interval->valueint >= 0) {
+    l->c.frame_interval = interval->valueint;
+  }
+
+  cJSON *mb = cJSON_GetObjectItemCaseSensitive(config, "stream_buffer_mb");
+  if (cJSON_IsNumber(mb) && mb->valuedouble >= 1) {
+    l->c.stream_buffer = (size_t)mb->valuedouble << 20;
+  }
+
+  cJSON *keywords = cJSON_GetObjectItemCaseSensitive(config, "keywords");
+  if (cJSON_IsArray(keywords)) {
+    cJSON *element;
+    cJSON_ArrayForEach(element, keywords) {
+      if (cJSON_IsString(element)) {
+        keywords_add(l, element->valuestring);
+      }
+    }
+  }
+
+  cJSON *matcher = cJSON_GetObjectItemCaseSensitive(config, "matcher");
+  if (cJSON_IsString(matcher)) {
+    l->c.matcher = strdup(matcher->valuestring);
   }
 
   cJSON_Delete(config);
@@ -85,11 +170,17 @@ void parse_config(Loggy *l, char *path) {
 void write_status_message(Loggy *l, const char *message, ...) {
   va_list args;
   va_start(args, message);
-  char status_buffer[1024];
-  int len = vsnprintf(status_buffer, sizeof(status_buffer), message, args);
-  l->status_message.data = status_buffer;
-  l->status_message.len = len;
+  int len = vsnprintf(l->status_message.data, l->c.cols + 1, message, args);
+  if (len > l->c.cols)
+    len = l->c.cols;
+  l->status_message.len = len < 0 ? 0 : len;
   va_end(args);
+
+  // Keep the message on its line, whatever the formatted values contain.
+  for (int i = 0; i < l->status_message.len; i++) {
+    if (iscntrl((unsigned char)l->status_message.data[i]))
+      l->status_message.data[i] = ' ';
+  }
 }
 
 void enable_raw_mode() {
@@ -102,8 +193,9 @@ void enable_raw_mode() {
   raw.c_oflag &= ~(OPOST);
   raw.c_cflag |= (CS8);
   raw.c_lflag &= ~(ECHO | ICANON | IEXTEN);
+  // Reads never block; the main loop polls for input first.
   raw.c_cc[VMIN] = 0;
-  raw.c_cc[VTIME] = 1;
+  raw.c_cc[VTIME] = 0;
 
   if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
     die("tcsetattr");
@@ -114,16 +206,24 @@ void disable_raw_mode() {
     die("tcsetattr");
 }
 
+// Appends to buf, growing it geometrically. Buffers that are reused by
+// resetting len stop allocating once they are large enough.
 void buf_append(Buffer *buf, const char *s, int len) {
   if (len == 0)
     return;
-  char *new = realloc(buf->data, buf->len + len);
-  if (new == NULL) {
-    return;
+  if (buf->len + len > buf->capacity) {
+    int capacity = buf->capacity ? buf->capacity : 64;
+    while (capacity < buf->len + len)
+      capacity *= 2;
+    char *new = realloc(buf->data, capacity);
+    if (new == NULL) {
+      return;
+    }
+    buf->data = new;
+    buf->capacity = capacity;
   }
 
-  memcpy(&new[buf->len], s, len);
-  buf->data = new;
+  memcpy(&buf->data[buf->len], s, len);
   buf->len += len;
 }
 
@@ -138,13 +238,75 @@ int get_window_size(int *rows, int *cols) {
   }
 }
 
+static void close_file(Loggy *l) {
+  indexer_stop(l);
+  gz_close(l);
+  merge_close(l);
+  if (l->mapped) {
+    munmap(l->data, l->size);
+  }
+  arena_free(&l->arena);
+  if (l->cache.map == NULL)
+    free(l->rows - l->evicted);
+  cache_unmap(l);
+  l->cache = (IndexCache){0};
+
+  l->data = NULL;
+  l->size = 0;
+  l->mapped = false;
+  l->rows = NULL;
+  l->nrows = 0;
+  l->rowcap = 0;
+  l->evicted = 0;
+  l->ncols = 0;
+
+  search_reset(l);
+  l->cx = 0;
+  l->cy = 0;
+  l->rowoff = 0;
+  l->coloff = 0;
+}
+
+static bool map_file(Loggy *l, int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    return false;
+
+  char *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    return false;
+
+  l->data = map;
+  l->size = st.st_size;
+  l->mapped = true;
+
+  size_t from;
+  cache_load(l, &st, &from);
+  if (from < l->size)
+    indexer_start(l, from);
+  return true;
+}
+
 void open_file(Loggy *l, char *filename) {
+  close_file(l);
+  // filename may be l->filename itself when reopening.
+  char *name = strdup(filename);
   free(l->filename);
-  l->filename = strdup(filename);
+  l->filename = name;
+
+  int fd = open(l->filename, O_RDONLY);
+  if (fd == -1) {
+    die("open");
+  }
 
-  FILE *fp = fopen(filename, "r");
+  if (gz_open(l, fd) || map_file(l, fd)) {
+    close(fd);
+    return;
+  }
+
+  FILE *fp = fdopen(fd, "r");
   if (!fp) {
-    die("fopen");
+    die("fdopen");
   }
 
   char *line = NULL;
@@ -161,69 +323,297 @@ void open_file(Loggy *l, char *filename) {
 }
 
 void row_append(Loggy *l, char *s, size_t len) {
-  if (len > l->ncols) {
+  assert(!l->mapped);
+
+  size_t ref;
+  memcpy(arena_alloc(&l->arena, len, &ref), s, len);
+  row_append_view(l, ref, len);
+  l->size += len;
+}
+
+void row_append_view(Loggy *l, size_t off, size_t len) {
+  if (len > (size_t)l->ncols) {
     l->ncols = len;
   }
 
-  l->rows = realloc(l->rows, sizeof(Buffer) * (l->nrows + 1));
+  rows_reserve(l, 1);
 
   int cur = l->nrows;
 
+  l->rows[cur].off = off;
   l->rows[cur].len = len;
-  l->rows[cur].data = malloc(len + 1);
-  memcpy(l->rows[cur].data, s, len);
-  l->rows[cur].data[len] = '\0';
+  l->rows[cur].src = 0;
   l->nrows++;
 }
 
-void refresh_screen(Loggy *l) {
-  Buffer temp = {0, NULL};
-  buf_append(&temp, "\x1b[?25l", 6);
-  buf_append(&temp, "\x1b[H", 3);
+// Makes room for n more rows, growing the table geometrically so appending
+// a whole file costs amortized O(1) per row.
+void rows_reserve(Loggy *l, int n) {
+  if (l->nrows + n <= l->rowcap)
+    return;
+
+  // Rows evicted from the front leave room behind them. Move the rest down
+  // into it once that frees at least as many slots as it copies.
+  if (l->evicted > 0 && l->evicted >= l->nrows) {
+    memmove(l->rows - l->evicted, l->rows, sizeof(Row) * l->nrows);
+    l->rows -= l->evicted;
+    l->rowcap += l->evicted;
+    l->evicted = 0;
+    if (l->nrows + n <= l->rowcap)
+      return;
+  }
+
+  int rowcap = l->rowcap ? l->rowcap : 1024;
+  while (rowcap < l->nrows + n)
+    rowcap *= 2;
+
+  Row *rows;
+  if (l->cache.map) {
+    // The rows are still in the cache mapping, which cannot grow.
+    rows = malloc(sizeof(Row) * rowcap);
+    if (rows == NULL) {
+      die("malloc");
+    }
+    memcpy(rows, l->rows, sizeof(Row) * l->nrows);
+    cache_unmap(l);
+  } else {
+    rows = realloc(l->rows - l->evicted,
+                   sizeof(Row) * (l->evicted + rowcap));
+    if (rows == NULL) {
+      die("realloc");
+    }
+    rows += l->evicted;
+  }
+  l->rows = rows;
+  l->rowcap = rowcap;
+}
+
+// Drops the first n rows, whose bytes are about to be freed, and moves
+// everything that refers to rows up to match.
+void rows_evict(Loggy *l, int n) {
+  int drop = filter_evict(l, n);
+  search_evict(l, n);
+
+  l->cy = l->cy > drop ? l->cy - drop : 0;
+  l->rowoff = l->rowoff > drop ? l->rowoff - drop : 0;
+  // What is on screen moved up with the rows under it.
+  if (l->frame.rowoff >= drop) {
+    l->frame.rowoff -= drop;
+  } else {
+    l->frame.valid = false;
+  }
+
+  l->rows += n;
+  l->nrows -= n;
+  l->rowcap -= n;
+  l->evicted += n;
+}
+
+char *row_data(Loggy *l, int row) {
+  if (l->mapped)
+    return &l->data[l->rows[row].off];
+  if (l->gz)
+    return gz_data(l, l->rows[row].off, l->rows[row].len);
+  if (l->merge)
+    return merge_data(l, row);
+  return arena_at(&l->arena, l->rows[row].off);
+}
 
-  draw_screen(l, &temp);
+// Number of leading bytes two lines share that are plain one-column
+// characters, so the terminal cursor can be placed right after them.
+static int common_prefix(Buffer *a, Buffer *b) {
+  int n = 0;
+  while (n < a->len && n < b->len && a->data[n] == b->data[n] &&
+         a->data[n] >= ' ' && a->data[n] < 0x7f)
+    n++;
+  return n;
+}
+
+static bool line_equal(Buffer *a, Buffer *b) {
+  return a->len == b->len && memcmp(a->data, b->data, a->len) == 0;
+}
+
+// If the text area of the new frame is the old one moved by the change in
+// rowoff, scrolls that region on the terminal and shifts the shadow lines to
+// match, leaving only the rows scrolled into view to be redrawn.
+static void scroll_frame(Loggy *l, Buffer *out) {
+  Frame *f = &l->frame;
+  int rows = l->c.rows;
+  int delta = l->rowoff - f->rowoff;
+  if (delta == 0 || delta >= rows || -delta >= rows || l->coloff != f->coloff)
+    return;
+
+  int same = 0;
+  for (int i = 0; i < rows; i++) {
+    int j = i + delta;
+    if (j >= 0 && j < rows && line_equal(&f->next[i], &f->lines[j]))
+      same++;
+  }
+  if (same * 2 < rows)
+    return;
 
   char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%d;%dH", l->cy - l->rowoff + 1,
-           l->cx - l->coloff + 1);
-  buf_append(&temp, buf, strlen(buf));
+  int len = snprintf(buf, sizeof(buf), "\x1b[1;%dr\x1b[%d%c\x1b[r", rows,
+                     delta > 0 ? delta : -delta, delta > 0 ? 'S' : 'T');
+  buf_append(out, buf, len);
+
+  // Rotate the shadow lines the same way; the rows that scrolled in are
+  // blank on the terminal now.
+  Buffer moved[rows];
+  for (int i = 0; i < rows; i++)
+    moved[i] = f->lines[((i + delta) % rows + rows) % rows];
+  for (int i = 0; i < rows; i++) {
+    f->lines[i] = moved[i];
+    int j = i + delta;
+    if (j < 0 || j >= rows)
+      f->lines[i].len = 0;
+  }
+}
+
+static void frame_resize(Loggy *l) {
+  Frame *f = &l->frame;
+  int nlines = l->c.rows + 2;
+  if (f->nlines == nlines)
+    return;
+
+  for (int i = 0; i < f->nlines; i++) {
+    free(f->lines[i].data);
+    free(f->next[i].data);
+  }
+  free(f->lines);
+  free(f->next);
+  f->lines = calloc(nlines, sizeof(Buffer));
+  f->next = calloc(nlines, sizeof(Buffer));
+  if (f->lines == NULL || f->next == NULL) {
+    die("calloc");
+  }
+  f->nlines = nlines;
+  f->valid = false;
+}
+
+// Draws the new frame into a second set of line buffers, compares it with
+// what is on the terminal and only sends lines that changed, starting after
+// any unchanged prefix. Vertical scrolls are sent as a scroll of the text
+// region instead of redrawing every row.
+void refresh_screen(Loggy *l) {
+  Frame *f = &l->frame;
+  frame_resize(l);
+  if (f->updates > 1)
+    f->skipped += f->updates - 1;
+  f->updates = 0;
+
+  for (int i = 0; i < f->nlines; i++)
+    f->next[i].len = 0;
+  draw_screen(l, f->next);
+
+  // The cursor is hidden while lines are redrawn; a frame where only the
+  // cursor moved needs neither escape.
+  Buffer *out = &l->out;
+  out->len = 0;
+  buf_append(out, "\x1b[?25l", 6);
+  int hidden = out->len;
+
+  if (f->valid) {
+    scroll_frame(l, out);
+  }
+
+  char buf[32];
+  for (int i = 0; i < f->nlines; i++) {
+    Buffer *line = &f->next[i];
+    int col = 0;
+    if (f->valid) {
+      if (line_equal(line, &f->lines[i]))
+        continue;
+      col = common_prefix(line, &f->lines[i]);
+    }
+
+    int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH\x1b[K", i + 1, col + 1);
+    buf_append(out, buf, len);
+    buf_append(out, &line->data[col], line->len - col);
+  }
+
+  int len = snprintf(buf, sizeof(buf), "\x1b[%d;%dH", l->cy - l->rowoff + 1,
+                     l->cx - l->coloff + 1);
+  buf_append(out, buf, len);
+
+  int start = 0;
+  if (out->len == hidden + len) {
+    start = hidden;
+  } else {
+    buf_append(out, "\x1b[?25h", 6);
+  }
 
-  buf_append(&temp, "\x1b[?25h", 6);
+  write(STDOUT_FILENO, &out->data[start], out->len - start);
+  f->bytes = out->len - start;
+  clock_gettime(CLOCK_MONOTONIC, &f->drawn);
 
-  write(STDOUT_FILENO, temp.data, temp.len);
-  free(temp.data);
+  Buffer *lines = f->lines;
+  f->lines = f->next;
+  f->next = lines;
+  f->rowoff = l->rowoff;
+  f->coloff = l->coloff;
+  f->valid = true;
 }
 
-void find(Loggy *l, regex_t reg) {
-  for (int i = 0; i < l->nrows; i++) {
-    regmatch_t pmatch[1];
-
-    char *cur_line = l->rows[i].data;
-    regoff_t off = 0;
-    while (regexec(&reg, &cur_line[off], sizeof(pmatch) / sizeof(pmatch[0]),
-                   pmatch, 0) == 0) {
-      l->matches.matches =
-          realloc(l->matches.matches, sizeof(Match) * (l->matches.len + 1));
-      pmatch[0].rm_so += off;
-      l->matches.matches[l->matches.len] =
-          (Match){.regmatch = pmatch[0], .row = i};
-      l->matches.len++;
-      off += pmatch[0].rm_eo;
+// Draws data[from, to), with search matches in reverse video and keywords
+// in their colors. The two kinds of spans may overlap.
+static void draw_row(Buffer *b, const char *data, int from, int to,
+                     const regmatch_t *spans, int nspans,
+                     const KeywordSpan *keywords, int nkeywords) {
+  int i = 0, j = 0;
+  bool reverse = false;
+  int color = 0;
+  for (int pos = from; pos < to;) {
+    while (i < nspans && spans[i].rm_eo <= pos)
+      i++;
+    while (j < nkeywords && keywords[j].eo <= pos)
+      j++;
+
+    int next = to;
+    bool in_span = i < nspans && spans[i].rm_so <= pos;
+    if (i < nspans) {
+      int edge = in_span ? spans[i].rm_eo : spans[i].rm_so;
+      next = edge < next ? edge : next;
+    }
+    bool in_keyword = j < nkeywords && keywords[j].so <= pos;
+    if (j < nkeywords) {
+      int edge = in_keyword ? keywords[j].eo : keywords[j].so;
+      next = edge < next ? edge : next;
+    }
+
+    if (in_span != reverse) {
+      buf_append(b, in_span ? "\x1b[7m" : "\x1b[27m", in_span ? 4 : 5);
+      reverse = in_span;
+    }
+    int want = in_keyword ? keywords[j].color : 0;
+    if (want != color) {
+      char sgr[16];
+      buf_append(b, sgr,
+                 snprintf(sgr, sizeof(sgr), "\x1b[%dm", want ? want : 39));
+      color = want;
     }
+    buf_append(b, &data[pos], next - pos);
+    pos = next;
   }
+  if (reverse)
+    buf_append(b, "\x1b[27m", 5);
+  if (color)
+    buf_append(b, "\x1b[39m", 5);
 }
 
-void draw_screen(Loggy *l, Buffer *b) {
+// Renders each screen line into its own buffer: the text rows, then the
+// status bar and the message line.
+void draw_screen(Loggy *l, Buffer *lines) {
   Config c = l->c;
 
   for (int i = 0; i < c.rows; i++) {
-    buf_append(b, "\x1b[K", 3);
-
+    Buffer *b = &lines[i];
     int colstart = l->coloff;
     int offset = l->rowoff;
 
-    if (offset + i < l->nrows) {
-      int len = l->rows[offset + i].len - colstart;
+    if (offset + i < view_len(l)) {
+      int row = view_row(l, offset + i);
+      int len = l->rows[row].len - colstart;
 
       if (len > c.cols)
         len = c.cols;
@@ -233,30 +623,67 @@ void draw_screen(Loggy *l, Buffer *b) {
         len = 0;
       }
 
-      assert(colstart <= l->rows[offset + i].len);
+      assert(colstart <= l->rows[row].len);
 
-      buf_append(b, &l->rows[offset + i].data[colstart], len);
+      const regmatch_t *spans;
+      int nspans = highlight_row(l, row, &spans);
+      const KeywordSpan *keywords;
+      int nkeywords = keywords_row(l, row, &keywords);
+      draw_row(b, row_data(l, row), colstart, colstart + len, spans, nspans,
+               keywords, nkeywords);
     } else {
       buf_append(b, "~", 1);
     }
-
-    buf_append(b, "\r\n", 2);
   }
 
-  draw_status_bar(l, b);
-  draw_status_message(l, b, "");
+  draw_status_bar(l, &lines[c.rows]);
+  draw_status_message(l, &lines[c.rows + 1], "");
 }
 
 void draw_status_bar(Loggy *l, Buffer *b) {
   buf_append(b, "\x1b[7m", 4);
 
   char left_status[80];
-  int len = snprintf(left_status, sizeof(left_status), "%.20s",
-                     l->filename ? l->filename : "[No Name]");
+  const char *name = l->filename ? l->filename : "[No Name]";
+  char files[32];
+  if (l->stream.enabled) {
+    name = "[stdin]";
+  } else if (l->merge) {
+    snprintf(files, sizeof(files), "[%d files]", merge_count(l));
+    name = files;
+  }
+  int len = snprintf(left_status, sizeof(left_status), "%.20s", name);
   if (len > l->c.cols)
     len = l->c.cols;
   char right_status[l->c.cols - len];
-  int rlen = snprintf(right_status, sizeof(right_status), "%d lines", l->nrows);
+  char counts[64] = "";
+  Matches *m = &l->matches;
+  if (m->pattern && m->count_only) {
+    snprintf(counts, sizeof(counts), "%ld matches on %d lines%s  ",
+             m->list.count + m->wrap.count, m->list.lines + m->wrap.lines,
+             search_busy(l) ? "..." : "");
+  }
+  int rlen;
+  if (l->indexer.running) {
+    rlen = snprintf(right_status, sizeof(right_status), "%s%d lines (%d%%)",
+                    counts, l->nrows,
+                    (int)(l->indexer.progress * 100 / l->size));
+  } else if (!merge_done(l)) {
+    rlen = snprintf(right_status, sizeof(right_status), "%s%d lines (%d%%)",
+                    counts, l->nrows, merge_progress(l));
+  } else if (l->filter.enabled) {
+    rlen = snprintf(right_status, sizeof(right_status), "%s%d/%d lines",
+                    counts, l->filter.len, l->nrows);
+  } else {
+    rlen = snprintf(right_status, sizeof(right_status), "%s%d lines", counts,
+                    l->nrows);
+  }
+  if (l->follow.enabled && rlen < (int)sizeof(right_status)) {
+    rlen += snprintf(&right_status[rlen], sizeof(right_status) - rlen,
+                     " [follow]");
+  }
+  if (rlen >= (int)sizeof(right_status))
+    rlen = sizeof(right_status) - 1;
   buf_append(b, left_status, len);
   while (len < l->c.cols) {
     if (len + rlen == l->c.cols) {
@@ -272,6 +699,15 @@ void draw_status_bar(Loggy *l, Buffer *b) {
 }
 
 void draw_status_message(Loggy *l, Buffer *b, char *status_message) {
+  if (l->debug && l->status_message.len == 0) {
+    char stats[80];
+    int len = snprintf(stats, sizeof(stats),
+                       "last frame: %d bytes, skipped frames: %ld",
+                       l->frame.bytes, l->frame.skipped);
+    buf_append(b, stats, len < l->c.cols ? len : l->c.cols);
+    return;
+  }
+
   buf_append(b, l->status_message.data, l->status_message.len);
   int padding = l->c.cols - l->status_message.len;
   while (padding > 0) {
@@ -282,6 +718,33 @@ void draw_status_message(Loggy *l, Buffer *b, char *status_message) {
 
 void clear_status_message(Loggy *l) { l->status_message.len = 0; }
 
+// Milliseconds until the next frame may be drawn, or 0 if it may be now.
+static int frame_wait(Loggy *l) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  long elapsed = (now.tv_sec - l->frame.drawn.tv_sec) * 1000 +
+                 (now.tv_nsec - l->frame.drawn.tv_nsec) / 1000000;
+  return elapsed >= l->c.frame_interval ? 0 : l->c.frame_interval - elapsed;
+}
+
+// Picks up a new terminal size. The next frame is drawn in full.
+static void resize(Loggy *l) {
+  if (get_window_size(&l->c.rows, &l->c.cols) == -1) {
+    die("get_window_size");
+  }
+  l->c.rows -= 2;
+
+  char *data = realloc(l->status_message.data, l->c.cols + 1);
+  if (data == NULL) {
+    die("realloc");
+  }
+  l->status_message.data = data;
+  l->status_message.capacity = l->c.cols + 1;
+  if (l->status_message.len > l->c.cols)
+    l->status_message.len = l->c.cols;
+  l->frame.valid = false;
+}
+
 void scroll(Loggy *l) {
   if (l->cy < l->rowoff) {
     l->rowoff = l->cy;
@@ -299,25 +762,111 @@ void scroll(Loggy *l) {
 }
 
 int main(int argc, char *argv[]) {
+  bool follow = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "f")) != -1) {
+    switch (opt) {
+    case 'f':
+      follow = true;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-f] [file...]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // With log data piped in, keep reading it from a copy of stdin and take
+  // keys from the terminal instead.
+  int input = -1;
+  if (!isatty(STDIN_FILENO)) {
+    input = dup(STDIN_FILENO);
+    int tty = open("/dev/tty", O_RDONLY);
+    if (input == -1 || tty == -1 || dup2(tty, STDIN_FILENO) == -1) {
+      perror("/dev/tty");
+      return 1;
+    }
+    close(tty);
+  }
+
   Loggy l;
   init(&l);
 
-  if (argc >= 2) {
-    open_file(&l, argv[1]);
+  if (argc - optind > 1) {
+    merge_open(&l, argc - optind, &argv[optind]);
+    if (input != -1)
+      close(input);
+  } else if (optind < argc) {
+    open_file(&l, argv[optind]);
+    if (input != -1)
+      close(input);
+  } else if (input != -1) {
+    stream_start(&l, input);
+  }
+  if (follow) {
+    follow_start(&l);
   }
 
+  bool redraw = true;
   while (1) {
-    scroll(&l);
-    refresh_screen(&l);
-    switch (l.mode) {
-    case NORMAL:
-      process_key_normal(&l);
-      break;
-    case SEARCH:
-      process_key_search(&l);
-      break;
-    default:
-      break;
+    Frame *f = &l.frame;
+    // Apply every key that has arrived, not just one per frame.
+    while (process_key(&l)) {
+      f->updates++;
+      redraw = true;
+    }
+
+    bool changed = false;
+    if (indexer_poll(&l)) {
+      changed = true;
+    }
+    if (follow_poll(&l)) {
+      changed = true;
+    }
+    if (stream_poll(&l)) {
+      changed = true;
+    }
+    if (merge_step(&l)) {
+      changed = true;
+    }
+    if (goto_time_poll(&l)) {
+      changed = true;
+    }
+    if (jump_poll(&l)) {
+      changed = true;
+    }
+    if (search_step(&l)) {
+      changed = true;
+    }
+    if (keywords_step(&l)) {
+      changed = true;
+    }
+    if (filter_update(&l)) {
+      changed = true;
+    }
+    if (changed) {
+      f->updates++;
+      redraw = true;
+    }
+
+    // Draw at most once per frame interval; updates in between are folded
+    // into the next frame.
+    int timeout = -1;
+    if (redraw) {
+      timeout = frame_wait(&l);
+      if (timeout == 0) {
+        scroll(&l);
+        refresh_screen(&l);
+        redraw = false;
+        timeout = -1;
+      }
+    }
+
+    // Sleep until something happens, unless a search, merge or keyword jump
+    // has work left.
+    bool busy = search_busy(&l) || merge_busy(&l) || keywords_busy(&l);
+    if (events_wait(&l, busy ? 0 : timeout)) {
+      resize(&l);
+      redraw = true;
     }
   }
 
@@ -1,45 +1,290 @@
 #ifndef LOGGY_H_
 #define LOGGY_H_
 
+#include "arena.h"
+#include "matcher.h"
+#include <pthread.h>
 #include <regex.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
 #include <termios.h>
+#include <time.h>
 
-typedef enum { NORMAL, SEARCH } mode;
+typedef enum { NORMAL, SEARCH, TIME, KEYWORD } mode;
 
 typedef struct {
   int rows;
   int cols;
+  // strptime formats for the timestamps that start each row.
+  char **time_formats;
+  int ntime_formats;
+  // Bytes of piped input kept before the oldest lines are evicted.
+  size_t stream_buffer;
+  // Shortest time between two frames, in milliseconds.
+  int frame_interval;
+  // Name of the engine searches try first, see matcher.c.
+  char *matcher;
 } Config;
 
 typedef struct {
   int len;
   char *data;
+  int capacity;
 } Buffer;
 
 typedef struct {
-  regmatch_t regmatch;
-  int row;
-} Match;
+  size_t off;
+  int len;
+  // The file the row is in when several are merged. Sits in what would
+  // otherwise be padding.
+  int src;
+} Row;
 
+// Matches in row order, in fixed-size chunks; every chunk but the last is
+// full. A match is its row, stored as a varint delta from the row before it
+// (the chunk's first for the first one), and a 32-bit column.
 typedef struct {
-  int cur;
+  int first;
+  int last;
+  uint8_t *deltas;
+  size_t nbytes;
+  size_t capacity;
+  uint32_t *cols;
+} MatchChunk;
+
+typedef struct MatchList {
+  MatchChunk *chunks;
+  int nchunks;
+  int capacity;
   int len;
-  Match *matches;
+  // Matches and distinct rows seen, including those not stored when only
+  // counting. lastrow is the row of the latest one.
+  long count;
+  int lines;
+  int lastrow;
+} MatchList;
+
+typedef struct {
+  MatchList list;
+  // Only count matches and the rows they are on, without storing them.
+  bool count_only;
+
+  // The active search. Rows are searched forward from `start`, where the
+  // viewport was when the search began, then from the top back down to
+  // `start`. Rows [start, scanned) and [0, wrapped) are done; matches from
+  // the second pass collect in `wrap` until it completes. Repeating the
+  // search or following a growing file only scans rows past `scanned`.
+  char *pattern;
+  Matcher matcher;
+  int start;
+  int scanned;
+  int wrapped;
+  MatchList wrap;
+
+  // A substring every match must contain, used to skip rows before running
+  // the regex. Empty if the pattern has none.
+  char *literal;
+  size_t literallen;
+
+  // Bumped whenever matches are dropped or reordered rather than appended.
+  int version;
+
+  // Set when the pattern was typed after '?' rather than '/': 'n' then goes
+  // to earlier matches and 'N' to later ones.
+  bool backward;
+
+  // While the pattern is being typed, and after Enter until it has, the
+  // cursor jumps to the first match after where it was when '/' was
+  // pressed, or before it for '?'.
+  bool preview;
+  bool jumped;
+  int origin_cx, origin_cy;
 } Matches;
 
+// Scans a mapped file for line boundaries on a background thread. Rows are
+// handed over in batches through `pending` and moved into the row table by
+// indexer_poll on the main thread, so only the main thread touches l->rows.
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  const char *data;
+  size_t size;
+  // Where scanning starts; rows before it are already in the table.
+  size_t from;
+  // Written to whenever there is something for indexer_poll.
+  int wake;
+
+  // Guarded by lock.
+  Row *pending;
+  int npending;
+  int capacity;
+  int ncols;
+  size_t scanned;
+  bool done;
+  bool stop;
+
+  // Main thread only.
+  bool running;
+  size_t progress;
+} Indexer;
+
+// Rows matching the current search, in file order. When enabled, only these
+// rows are shown and cursor motions move between them.
+typedef struct {
+  bool enabled;
+  int *rows;
+  int len;
+  int capacity;
+
+  // How many matches have been turned into rows, and the matches version
+  // they came from.
+  int consumed;
+  int version;
+} Filter;
+
+// What is on the terminal, one rendered buffer per screen line, and the
+// buffers the next frame is drawn into before the two are compared.
+typedef struct {
+  Buffer *lines;
+  Buffer *next;
+  int nlines;
+  int rowoff, coloff;
+  bool valid;
+
+  // Bytes written to the terminal for the last frame.
+  int bytes;
+
+  // When the last frame was drawn, how many updates (keys, new rows, search
+  // results) are waiting for the next one, and how many updates were folded
+  // into a later frame instead of getting one of their own.
+  struct timespec drawn;
+  int updates;
+  long skipped;
+} Frame;
+
+typedef struct SearchWorker SearchWorker;
+typedef struct Gz Gz;
+typedef struct Merge Merge;
+typedef struct Highlights Highlights;
+typedef struct Keywords Keywords;
+
+// Worker threads that search chunks of rows in parallel. A job is the range
+// [from, to) split into nchunks chunks; workers claim chunks through `next`
+// and the submitting thread waits for `remaining` to drop to zero.
+typedef struct {
+  SearchWorker *workers;
+  int nworkers;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t idle;
+
+  // Guarded by lock. generation changes whenever the pattern does, telling
+  // workers to recompile their copy of it.
+  int generation;
+  int from, to;
+  int next;
+  int nchunks;
+  int remaining;
+  MatchList *results;
+} SearchPool;
+
+// Row index read from the on-disk cache. Until the row table has to grow,
+// rows point into map; the first nrows rows are known to be in the cache
+// file. dev, ino and mtime identify the file the rows belong to.
+typedef struct {
+  char *map;
+  size_t mapsize;
+  int nrows;
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+} IndexCache;
+
+// State for following a file that is being appended to (tail -f).
+typedef struct {
+  bool enabled;
+  int fd;
+  int wd;
+  int dirwd;
+  dev_t dev;
+  ino_t ino;
+  bool changed;
+
+  // Whether to keep the cursor on the last row as rows are appended, and
+  // the cursor row last seen, to notice when the user moves away.
+  bool stick;
+  int cy;
+} Follow;
+
+// Log data arriving on a pipe. fd is -1 once the writer has gone away.
+// partial holds the start of a line whose newline has not been read yet.
+typedef struct {
+  bool enabled;
+  int fd;
+  Buffer partial;
+} Stream;
+
+// Descriptors the main loop sleeps on, besides the tty and the input files.
+typedef struct {
+  int sigfd;
+  int wakefd;
+} Events;
+
 typedef struct Loggy {
   Config c;
   mode mode;
+  // Count typed before a motion, like the 50 in "50j", and the first key of
+  // a two-key command like "gg".
+  int count;
+  char pending;
+  // A G, N% or Ngg waiting for the merge to reach its row, and its count.
+  char jump;
+  int jump_count;
   char *filename;
   Buffer status_message;
 
   Matches matches;
+  SearchPool pool;
+  // Matches of the current pattern in rows drawn recently.
+  Highlights *highlights;
+  // Words shown in their own colors, from the config or typed after 'K'.
+  Keywords *keywords;
+  Filter filter;
+  Frame frame;
+  // Escape sequences for the frame being written, reused across frames.
+  Buffer out;
+  bool debug;
 
   int cx, cy;
   int rowoff, coloff;
-  Buffer *rows;
+
+  // Backing bytes for all rows: either a read-only mapping of the file, or
+  // an arena filled by row_append when the input cannot be mapped.
+  char *data;
+  size_t size;
+  bool mapped;
+  Arena arena;
+  // Set instead when the file is gzip-compressed; row offsets are then into
+  // the uncompressed data.
+  Gz *gz;
+  // Set instead when several files are shown merged by time; rows point
+  // into the file given by their src.
+  Merge *merge;
+  // A time typed after 't' that the merge has not reached yet.
+  char *pending_time;
+
+  Events events;
+  Indexer indexer;
+  IndexCache cache;
+  Follow follow;
+  Stream stream;
+  Row *rows;
   int nrows;
+  int rowcap;
+  // Rows dropped from the front of the table; their slots sit before rows.
+  int evicted;
   int ncols;
 } Loggy;
 
@@ -55,11 +300,14 @@ void open_file(Loggy *l, char *filename);
 void write_status_message(Loggy *l, const char *message, ...);
 void parse_config(Loggy *l, char *path);
 void row_append(Loggy *l, char *s, size_t len);
-void draw_screen(Loggy *l, Buffer *buf);
+void row_append_view(Loggy *l, size_t off, size_t len);
+void rows_reserve(Loggy *l, int n);
+void rows_evict(Loggy *l, int n);
+char *row_data(Loggy *l, int row);
+void draw_screen(Loggy *l, Buffer *lines);
 void draw_status_bar(Loggy *l, Buffer *b);
 void draw_status_message(Loggy *l, Buffer *b, char *status_message);
 void clear_status_message(Loggy *l);
 void refresh_screen(Loggy *l);
-void find(Loggy *l, regex_t reg);
 
 #endif // LOGGY_H_
@@ -0,0 +1,70 @@
+#include "matcher.h"
+#include "common.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Engines in order of preference. A pattern goes to the first engine that
+// can compile it, starting from the configured one.
+static const MatcherEngine *engines[] = {&dfa_engine, &posix_engine};
+
+#define NENGINES (int)(sizeof(engines) / sizeof(engines[0]))
+
+static void *posix_compile(const char *pattern) {
+  regex_t *regex = malloc(sizeof(regex_t));
+  if (regex == NULL) {
+    die("malloc");
+  }
+  if (regcomp(regex, pattern, 0)) {
+    free(regex);
+    return NULL;
+  }
+  return regex;
+}
+
+static bool posix_exec(void *impl, const char *s, regoff_t len, regoff_t off,
+                       regmatch_t *match) {
+  // Rows are not NUL-terminated, so bound the match with REG_STARTEND.
+  match->rm_so = off;
+  match->rm_eo = len;
+  int eflags = REG_STARTEND | (off > 0 ? REG_NOTBOL : 0);
+  return regexec(impl, s, 1, match, eflags) == 0;
+}
+
+static void posix_free(void *impl) {
+  regfree(impl);
+  free(impl);
+}
+
+const MatcherEngine posix_engine = {"posix", posix_compile, posix_exec,
+                                    posix_free};
+
+// Compiles pattern with the engine named engine, or the first one if NULL,
+// falling back to the engines after it. Returns false if none can.
+bool matcher_compile(Matcher *m, const char *pattern, const char *engine) {
+  int first = 0;
+  for (int i = 0; engine && i < NENGINES; i++) {
+    if (strcmp(engines[i]->name, engine) == 0)
+      first = i;
+  }
+
+  for (int i = first; i < NENGINES; i++) {
+    void *impl = engines[i]->compile(pattern);
+    if (impl) {
+      m->engine = engines[i];
+      m->impl = impl;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool matcher_exec(Matcher *m, const char *s, regoff_t len, regoff_t off,
+                  regmatch_t *match) {
+  return m->engine->exec(m->impl, s, len, off, match);
+}
+
+void matcher_free(Matcher *m) {
+  m->engine->free(m->impl);
+  m->engine = NULL;
+  m->impl = NULL;
+}
@@ -0,0 +1,33 @@
+#ifndef MATCHER_H_
+#define MATCHER_H_
+
+#include <regex.h>
+#include <stdbool.h>
+
+// A way of running a POSIX basic regular expression. compile returns NULL if
+// the pattern is invalid or uses something the engine does not support.
+// exec finds the leftmost-longest match in s[off, len), with '^' matching
+// only at 0 and '$' only at len, like regexec with REG_STARTEND. Compiled
+// patterns keep scratch state, so one must not be used by two threads.
+typedef struct {
+  const char *name;
+  void *(*compile)(const char *pattern);
+  bool (*exec)(void *impl, const char *s, regoff_t len, regoff_t off,
+               regmatch_t *match);
+  void (*free)(void *impl);
+} MatcherEngine;
+
+extern const MatcherEngine dfa_engine;
+extern const MatcherEngine posix_engine;
+
+typedef struct {
+  const MatcherEngine *engine;
+  void *impl;
+} Matcher;
+
+bool matcher_compile(Matcher *m, const char *pattern, const char *engine);
+bool matcher_exec(Matcher *m, const char *s, regoff_t len, regoff_t off,
+                  regmatch_t *match);
+void matcher_free(Matcher *m);
+
+#endif // MATCHER_H_
@@ -0,0 +1,224 @@
+#include "matchlist.h"
+#include "common.h"
+#include <stdlib.h>
+
+// Matches per chunk. Finding match i decodes at most this many row deltas.
+#define MATCH_CHUNK 4096
+
+static int nused(const MatchList *list) {
+  return (list->len + MATCH_CHUNK - 1) / MATCH_CHUNK;
+}
+
+static MatchChunk *chunk_for(MatchList *list, int row) {
+  int c = list->len / MATCH_CHUNK;
+  if (c == list->nchunks) {
+    if (list->nchunks == list->capacity) {
+      int capacity = list->capacity ? list->capacity * 2 : 4;
+      MatchChunk *chunks = realloc(list->chunks, sizeof(MatchChunk) * capacity);
+      if (chunks == NULL) {
+        die("realloc");
+      }
+      list->chunks = chunks;
+      list->capacity = capacity;
+    }
+    MatchChunk *chunk = &list->chunks[list->nchunks++];
+    chunk->capacity = MATCH_CHUNK;
+    chunk->deltas = malloc(chunk->capacity);
+    chunk->cols = malloc(sizeof(uint32_t) * MATCH_CHUNK);
+    if (chunk->deltas == NULL || chunk->cols == NULL) {
+      die("malloc");
+    }
+  }
+
+  MatchChunk *chunk = &list->chunks[c];
+  if (list->len % MATCH_CHUNK == 0) {
+    chunk->first = chunk->last = row;
+    chunk->nbytes = 0;
+  }
+  return chunk;
+}
+
+// Counts a match at row and column col, and unless only counting, stores it.
+// Matches must be added in order.
+void matchlist_add(MatchList *list, int row, int col, bool store) {
+  if (list->lines == 0 || row != list->lastrow)
+    list->lines++;
+  list->lastrow = row;
+  list->count++;
+  if (!store)
+    return;
+
+  MatchChunk *chunk = chunk_for(list, row);
+  // A varint needs at most five bytes for a 32-bit delta.
+  if (chunk->nbytes + 5 > chunk->capacity) {
+    size_t capacity = chunk->capacity * 2;
+    uint8_t *deltas = realloc(chunk->deltas, capacity);
+    if (deltas == NULL) {
+      die("realloc");
+    }
+    chunk->deltas = deltas;
+    chunk->capacity = capacity;
+  }
+
+  unsigned delta = row - chunk->last;
+  while (delta >= 0x80) {
+    chunk->deltas[chunk->nbytes++] = delta | 0x80;
+    delta >>= 7;
+  }
+  chunk->deltas[chunk->nbytes++] = delta;
+  chunk->cols[list->len % MATCH_CHUNK] = col;
+  chunk->last = row;
+  list->len++;
+}
+
+// Appends other, whose rows all come after those in list.
+void matchlist_concat(MatchList *list, const MatchList *other) {
+  if (other->len < other->count) {
+    list->count += other->count;
+    list->lines += other->lines;
+    list->lastrow = other->lastrow;
+    return;
+  }
+
+  MatchCursor c;
+  int row, col;
+  matchlist_seek(other, 0, &c);
+  while (matchlist_next(&c, &row, &col))
+    matchlist_add(list, row, col, true);
+}
+
+static unsigned read_delta(const MatchChunk *chunk, size_t *pos) {
+  unsigned delta = 0;
+  int shift = 0;
+  uint8_t b;
+  do {
+    b = chunk->deltas[(*pos)++];
+    delta |= (unsigned)(b & 0x7f) << shift;
+    shift += 7;
+  } while (b & 0x80);
+  return delta;
+}
+
+// Positions c so that matchlist_next returns match i.
+void matchlist_seek(const MatchList *list, int i, MatchCursor *c) {
+  c->list = list;
+  c->i = i;
+  c->pos = 0;
+  if (i >= list->len)
+    return;
+
+  const MatchChunk *chunk = &list->chunks[i / MATCH_CHUNK];
+  c->row = chunk->first;
+  for (int k = i % MATCH_CHUNK; k > 0; k--) {
+    c->row += read_delta(chunk, &c->pos);
+  }
+}
+
+bool matchlist_next(MatchCursor *c, int *row, int *col) {
+  const MatchList *list = c->list;
+  if (c->i >= list->len)
+    return false;
+
+  const MatchChunk *chunk = &list->chunks[c->i / MATCH_CHUNK];
+  if (c->i % MATCH_CHUNK == 0) {
+    c->pos = 0;
+    c->row = chunk->first;
+  }
+  c->row += read_delta(chunk, &c->pos);
+
+  *row = c->row;
+  *col = chunk->cols[c->i % MATCH_CHUNK];
+  c->i++;
+  return true;
+}
+
+// Returns the index of the first match at or after column col of row, or
+// len if there is none. Chunks are searched by their last match, so only
+// the one holding the answer is decoded.
+int matchlist_find(const MatchList *list, int row, int col) {
+  int left = 0, right = nused(list);
+  while (left < right) {
+    int middle = (left + right) / 2;
+    const MatchChunk *chunk = &list->chunks[middle];
+    int n = middle < list->len / MATCH_CHUNK ? MATCH_CHUNK
+                                             : list->len % MATCH_CHUNK;
+    if (chunk->last < row ||
+        (chunk->last == row && chunk->cols[n - 1] < (uint32_t)col)) {
+      left = middle + 1;
+    } else {
+      right = middle;
+    }
+  }
+
+  MatchCursor c;
+  int r, cl;
+  matchlist_seek(list, left * MATCH_CHUNK, &c);
+  while (matchlist_next(&c, &r, &cl)) {
+    if (r > row || (r == row && cl >= col))
+      return c.i - 1;
+  }
+  return list->len;
+}
+
+// Drops the matches on row and below.
+void matchlist_truncate(MatchList *list, int row) {
+  int keep = matchlist_find(list, row, 0);
+  if (keep == list->len)
+    return;
+
+  MatchCursor c;
+  int r, col, prev = -1;
+  matchlist_seek(list, keep, &c);
+  while (matchlist_next(&c, &r, &col)) {
+    if (r != prev)
+      list->lines--;
+    prev = r;
+  }
+  list->count -= list->len - keep;
+
+  matchlist_seek(list, keep, &c);
+  list->len = keep;
+  if (keep % MATCH_CHUNK != 0) {
+    MatchChunk *chunk = &list->chunks[keep / MATCH_CHUNK];
+    chunk->nbytes = c.pos;
+    chunk->last = c.row;
+    list->lastrow = c.row;
+  } else if (keep > 0) {
+    list->lastrow = list->chunks[keep / MATCH_CHUNK - 1].last;
+  }
+
+  // Keep one empty chunk around for what gets found next.
+  int keepchunks = list->len / MATCH_CHUNK + 1;
+  while (list->nchunks > keepchunks) {
+    MatchChunk *chunk = &list->chunks[--list->nchunks];
+    free(chunk->deltas);
+    free(chunk->cols);
+  }
+}
+
+// Drops the matches in rows below n and renumbers the rest.
+void matchlist_evict(MatchList *list, int n) {
+  MatchList rest = {0};
+  MatchCursor c;
+  int row, col;
+  matchlist_seek(list, matchlist_find(list, n, 0), &c);
+  while (matchlist_next(&c, &row, &col))
+    matchlist_add(&rest, row - n, col, true);
+  matchlist_free(list);
+  *list = rest;
+}
+
+void matchlist_clear(MatchList *list) {
+  matchlist_truncate(list, 0);
+  list->count = 0;
+  list->lines = 0;
+}
+
+void matchlist_free(MatchList *list) {
+  for (int i = 0; i < list->nchunks; i++) {
+    free(list->chunks[i].deltas);
+    free(list->chunks[i].cols);
+  }
+  free(list->chunks);
+  *list = (MatchList){0};
+}
@@ -0,0 +1,24 @@
+#ifndef MATCHLIST_H_
+#define MATCHLIST_H_
+
+#include "loggy.h"
+
+// Reads matches out of a MatchList in order, starting anywhere.
+typedef struct {
+  const MatchList *list;
+  int i;
+  size_t pos;
+  int row;
+} MatchCursor;
+
+void matchlist_add(MatchList *list, int row, int col, bool store);
+void matchlist_concat(MatchList *list, const MatchList *other);
+void matchlist_seek(const MatchList *list, int i, MatchCursor *c);
+bool matchlist_next(MatchCursor *c, int *row, int *col);
+int matchlist_find(const MatchList *list, int row, int col);
+void matchlist_truncate(MatchList *list, int row);
+void matchlist_evict(MatchList *list, int n);
+void matchlist_clear(MatchList *list);
+void matchlist_free(MatchList *list);
+
+#endif // MATCHLIST_H_
@@ -0,0 +1,303 @@
+#define _DEFAULT_SOURCE
+
+#include "merge.h"
+#include "common.h"
+#include "loggy.h"
+#include "scan.h"
+#include "timestamp.h"
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Bytes of a file indexed at a time, as the merge reaches them.
+#define MERGE_CHUNK (1 << 20)
+// Rows merged per call to merge_step.
+#define MERGE_BUDGET 16384
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+// One of the merged files. Its rows are indexed only as far as the merge
+// has got; next is the first row not yet in the merged view. If stamped is
+// set, that row starts with a timestamp and key holds it.
+typedef struct {
+  char *data;
+  size_t size;
+  size_t scanned;
+  Row *rows;
+  int nrows;
+  int capacity;
+  int next;
+  bool stamped;
+  TimeKey key;
+} Source;
+
+// A k-way merge of the sources. heap holds the indices of the sources with
+// rows left, ordered by the key of their next row. last is the key of the
+// latest stamped row merged. Rows are merged only until there are want of
+// them and one stamped at or after until is in.
+struct Merge {
+  Source *sources;
+  int nsources;
+  int *heap;
+  int nheap;
+  size_t total;
+  TimeKey last;
+  int want;
+  TimeKey until;
+};
+
+// Length of the line data[start, end) without trailing carriage returns.
+static size_t line_len(const char *data, size_t start, size_t end) {
+  size_t len = end - start;
+  while (len > 0 && data[start + len - 1] == '\r')
+    len--;
+  return len;
+}
+
+// Indexes the source up to its next MERGE_CHUNK boundary. Rows already in
+// the merged view are dropped first; only the merge cursor reads them.
+static void source_index(Source *s) {
+  s->nrows -= s->next;
+  memmove(s->rows, &s->rows[s->next], sizeof(Row) * s->nrows);
+  s->next = 0;
+
+  size_t end = s->scanned + MERGE_CHUNK < s->size ? s->scanned + MERGE_CHUNK
+                                                  : s->size;
+  size_t nl[4096];
+  size_t start = s->scanned;
+  while (start < end) {
+    size_t n = scan_newlines(s->data, start, end, nl, ARRAY_SIZE(nl));
+    if (s->nrows + (int)n + 1 > s->capacity) {
+      while (s->nrows + (int)n + 1 > s->capacity)
+        s->capacity = s->capacity ? s->capacity * 2 : 1024;
+      s->rows = realloc(s->rows, sizeof(Row) * s->capacity);
+      if (s->rows == NULL) {
+        die("realloc");
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      s->rows[s->nrows++] =
+          (Row){.off = start, .len = line_len(s->data, start, nl[i])};
+      start = nl[i] + 1;
+    }
+    if (n < ARRAY_SIZE(nl))
+      break;
+  }
+
+  if (end == s->size) {
+    // A final line without a trailing newline.
+    if (start < s->size)
+      s->rows[s->nrows++] =
+          (Row){.off = start, .len = line_len(s->data, start, s->size)};
+    s->scanned = s->size;
+  } else {
+    // The partial line at the end of the chunk is indexed with the next.
+    s->scanned = start;
+  }
+}
+
+// Whether the source has a row i, indexing more of it if needed.
+static bool source_has(Source *s, int i) {
+  while (i >= s->nrows && s->scanned < s->size)
+    source_index(s);
+  return i < s->nrows;
+}
+
+static int compare_keys(const TimeKey *x, const TimeKey *y) {
+  if (x->sec != y->sec)
+    return x->sec < y->sec ? -1 : 1;
+  if (x->nsec != y->nsec)
+    return x->nsec < y->nsec ? -1 : 1;
+  return 0;
+}
+
+static bool before(Merge *m, int a, int b) {
+  int c = compare_keys(&m->sources[a].key, &m->sources[b].key);
+  return c != 0 ? c < 0 : a < b;
+}
+
+static void sift_down(Merge *m, int i) {
+  for (;;) {
+    int least = i;
+    int left = 2 * i + 1, right = 2 * i + 2;
+    if (left < m->nheap && before(m, m->heap[left], m->heap[least]))
+      least = left;
+    if (right < m->nheap && before(m, m->heap[right], m->heap[least]))
+      least = right;
+    if (least == i)
+      return;
+    int tmp = m->heap[i];
+    m->heap[i] = m->heap[least];
+    m->heap[least] = tmp;
+    i = least;
+  }
+}
+
+// Maps every file and starts merging them. Nothing is indexed up front;
+// merge_step pulls rows out of the files as it goes.
+void merge_open(Loggy *l, int nfiles, char **filenames) {
+  Merge *m = calloc(1, sizeof(Merge));
+  if (m == NULL) {
+    die("calloc");
+  }
+  m->sources = calloc(nfiles, sizeof(Source));
+  m->heap = malloc(sizeof(int) * nfiles);
+  if (m->sources == NULL || m->heap == NULL) {
+    die("calloc");
+  }
+
+  for (int i = 0; i < nfiles; i++) {
+    int fd = open(filenames[i], O_RDONLY);
+    if (fd == -1) {
+      die(filenames[i]);
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+      die("fstat");
+    }
+    Source *s = &m->sources[m->nsources];
+    if (st.st_size > 0) {
+      s->data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (s->data == MAP_FAILED) {
+        die("mmap");
+      }
+      s->size = st.st_size;
+      m->total += s->size;
+      // Every source starts out at the top of the heap with a zero key, so
+      // the first steps find each one's first timestamp.
+      m->heap[m->nheap++] = m->nsources++;
+    }
+    close(fd);
+  }
+
+  l->merge = m;
+}
+
+static void emit(Loggy *l, Source *s, int src) {
+  Row row = s->rows[s->next++];
+  row.src = src;
+  if (row.len > l->ncols)
+    l->ncols = row.len;
+  rows_reserve(l, 1);
+  l->rows[l->nrows++] = row;
+}
+
+// Asks for at least rows rows to be merged. Those on screen and a screen
+// past them are merged anyway; going further, like jumping to the end or
+// searching, asks for the rest.
+void merge_want(Loggy *l, long long rows) {
+  Merge *m = l->merge;
+  if (m != NULL && rows > m->want)
+    m->want = rows < INT_MAX ? rows : INT_MAX;
+}
+
+// Asks for rows to be merged up to the first stamped at or after key.
+void merge_want_time(Loggy *l, TimeKey key) {
+  Merge *m = l->merge;
+  if (m != NULL && compare_keys(&key, &m->until) > 0)
+    m->until = key;
+}
+
+// Whether the first row stamped at or after key has been merged, and so
+// every row before it.
+bool merge_reached(Loggy *l, TimeKey key) {
+  Merge *m = l->merge;
+  return m == NULL || m->nheap == 0 || compare_keys(&m->last, &key) >= 0;
+}
+
+// Whether rows rows have been merged, or every row there is if fewer.
+bool merge_has(Loggy *l, long long rows) {
+  Merge *m = l->merge;
+  return m == NULL || m->nheap == 0 || l->nrows >= rows;
+}
+
+// Moves up to MERGE_BUDGET rows into the merged view, in timestamp order,
+// as far as rows are wanted. Rows without a timestamp, like the rest of a
+// stack trace, stay right after the row before them in their own file.
+// Returns true if rows were added.
+bool merge_step(Loggy *l) {
+  Merge *m = l->merge;
+  if (m == NULL)
+    return false;
+  merge_want(l, (long long)l->rowoff + 2 * l->c.rows);
+
+  int budget = MERGE_BUDGET;
+  int nrows = l->nrows;
+  while (budget > 0 && merge_busy(l)) {
+    int src = m->heap[0];
+    Source *s = &m->sources[src];
+    if (s->stamped) {
+      emit(l, s, src);
+      m->last = s->key;
+      s->stamped = false;
+      budget--;
+    }
+
+    while (budget > 0 && source_has(s, s->next)) {
+      Row *row = &s->rows[s->next];
+      if (timestamp_key(l, &s->data[row->off], row->len, &s->key)) {
+        s->stamped = true;
+        break;
+      }
+      emit(l, s, src);
+      budget--;
+    }
+
+    if (!source_has(s, s->next)) {
+      m->heap[0] = m->heap[--m->nheap];
+      sift_down(m, 0);
+    } else if (s->stamped) {
+      sift_down(m, 0);
+    }
+  }
+  return l->nrows != nrows;
+}
+
+// Whether rows that are wanted are still to be merged.
+bool merge_busy(Loggy *l) {
+  Merge *m = l->merge;
+  return m && m->nheap > 0 &&
+         (l->nrows < m->want || !merge_reached(l, m->until));
+}
+
+bool merge_done(Loggy *l) {
+  return l->merge == NULL || l->merge->nheap == 0;
+}
+
+int merge_count(Loggy *l) { return l->merge->nsources; }
+
+// How far through the files the merge is, in percent of their bytes.
+int merge_progress(Loggy *l) {
+  Merge *m = l->merge;
+  if (m->total == 0)
+    return 100;
+  size_t done = 0;
+  for (int i = 0; i < m->nsources; i++) {
+    Source *s = &m->sources[i];
+    done += s->next < s->nrows ? s->rows[s->next].off : s->scanned;
+  }
+  return done * 100 / m->total;
+}
+
+char *merge_data(Loggy *l, int row) {
+  Row *r = &l->rows[row];
+  return &l->merge->sources[r->src].data[r->off];
+}
+
+void merge_close(Loggy *l) {
+  Merge *m = l->merge;
+  if (m == NULL)
+    return;
+  for (int i = 0; i < m->nsources; i++) {
+    munmap(m->sources[i].data, m->sources[i].size);
+    free(m->sources[i].rows);
+  }
+  free(m->sources);
+  free(m->heap);
+  free(m);
+  l->merge = NULL;
+}
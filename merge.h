@@ -0,0 +1,20 @@
+#ifndef MERGE_H_
+#define MERGE_H_
+
+#include "loggy.h"
+#include "timestamp.h"
+
+void merge_open(Loggy *l, int nfiles, char **filenames);
+void merge_want(Loggy *l, long long rows);
+void merge_want_time(Loggy *l, TimeKey key);
+bool merge_reached(Loggy *l, TimeKey key);
+bool merge_has(Loggy *l, long long rows);
+bool merge_step(Loggy *l);
+bool merge_busy(Loggy *l);
+bool merge_done(Loggy *l);
+int merge_count(Loggy *l);
+int merge_progress(Loggy *l);
+char *merge_data(Loggy *l, int row);
+void merge_close(Loggy *l);
+
+#endif // MERGE_H_
@@ -0,0 +1,178 @@
+#define _GNU_SOURCE
+
+#include "scan.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+scan_fn scan_newlines = scan_newlines_scalar;
+substr_fn scan_substr = scan_substr_scalar;
+
+size_t scan_newlines_scalar(const char *data, size_t from, size_t to,
+                            size_t *out, size_t max) {
+  size_t n = 0;
+  while (from < to && n < max) {
+    const char *nl = memchr(&data[from], '\n', to - from);
+    if (nl == NULL)
+      break;
+    out[n++] = nl - data;
+    from = nl - data + 1;
+  }
+  return n;
+}
+
+const char *scan_substr_scalar(const char *hay, size_t n, const char *needle,
+                               size_t k) {
+  return memmem(hay, n, needle, k);
+}
+
+#ifdef SCAN_X86
+
+// Emits the newline offsets of one block from its comparison bitmask. Returns
+// false once `out` is full.
+static inline int emit_mask(uint32_t mask, size_t base, size_t *out,
+                            size_t *n, size_t max) {
+  while (mask) {
+    if (*n == max)
+      return 0;
+    out[(*n)++] = base + __builtin_ctz(mask);
+    mask &= mask - 1;
+  }
+  return 1;
+}
+
+__attribute__((target("sse2"))) size_t
+scan_newlines_sse2(const char *data, size_t from, size_t to, size_t *out,
+                   size_t max) {
+  size_t n = 0;
+  const __m128i nl = _mm_set1_epi8('\n');
+  while (from + 16 <= to) {
+    __m128i block = _mm_loadu_si128((const __m128i *)&data[from]);
+    uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, nl));
+    if (!emit_mask(mask, from, out, &n, max))
+      return n;
+    from += 16;
+  }
+  return n + scan_newlines_scalar(data, from, to, &out[n], max - n);
+}
+
+__attribute__((target("avx2"))) size_t
+scan_newlines_avx2(const char *data, size_t from, size_t to, size_t *out,
+                   size_t max) {
+  size_t n = 0;
+  const __m256i nl = _mm256_set1_epi8('\n');
+  while (from + 64 <= to) {
+    __m256i lo = _mm256_loadu_si256((const __m256i *)&data[from]);
+    __m256i hi = _mm256_loadu_si256((const __m256i *)&data[from + 32]);
+    uint32_t mlo = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, nl));
+    uint32_t mhi = _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, nl));
+    if (!emit_mask(mlo, from, out, &n, max) ||
+        !emit_mask(mhi, from + 32, out, &n, max))
+      return n;
+    from += 64;
+  }
+  return n + scan_newlines_sse2(data, from, to, &out[n], max - n);
+}
+
+// Substring search that compares the first and last needle bytes against a
+// whole block at once and only runs memcmp on positions where both match.
+// Candidates are rare on log text, so most blocks cost two compares.
+static inline const char *verify_mask(uint32_t mask, const char *block,
+                                      const char *needle, size_t k) {
+  while (mask) {
+    int bit = __builtin_ctz(mask);
+    if (memcmp(&block[bit + 1], needle + 1, k - 2) == 0)
+      return &block[bit];
+    mask &= mask - 1;
+  }
+  return NULL;
+}
+
+__attribute__((target("sse2"))) const char *
+scan_substr_sse2(const char *hay, size_t n, const char *needle, size_t k) {
+  if (k < 2 || n < k)
+    return scan_substr_scalar(hay, n, needle, k);
+
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[k - 1]);
+  size_t i = 0;
+  for (; i + k - 1 + 16 <= n; i += 16) {
+    __m128i bf = _mm_loadu_si128((const __m128i *)&hay[i]);
+    __m128i bl = _mm_loadu_si128((const __m128i *)&hay[i + k - 1]);
+    uint32_t mask = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+    const char *found = verify_mask(mask, &hay[i], needle, k);
+    if (found)
+      return found;
+  }
+  return scan_substr_scalar(&hay[i], n - i, needle, k);
+}
+
+__attribute__((target("avx2"))) const char *
+scan_substr_avx2(const char *hay, size_t n, const char *needle, size_t k) {
+  if (k < 2 || n < k)
+    return scan_substr_scalar(hay, n, needle, k);
+
+  const __m256i first = _mm256_set1_epi8(needle[0]);
+  const __m256i last = _mm256_set1_epi8(needle[k - 1]);
+  size_t i = 0;
+  for (; i + k - 1 + 32 <= n; i += 32) {
+    __m256i bf = _mm256_loadu_si256((const __m256i *)&hay[i]);
+    __m256i bl = _mm256_loadu_si256((const __m256i *)&hay[i + k - 1]);
+    uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpeq_epi8(bf, first), _mm256_cmpeq_epi8(bl, last)));
+    const char *found = verify_mask(mask, &hay[i], needle, k);
+    if (found)
+      return found;
+  }
+  return scan_substr_sse2(&hay[i], n - i, needle, k);
+}
+
+void scan_init() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    scan_newlines = scan_newlines_avx2;
+    scan_substr = scan_substr_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    scan_newlines = scan_newlines_sse2;
+    scan_substr = scan_substr_sse2;
+  }
+}
+
+#else
+
+size_t scan_newlines_sse2(const char *data, size_t from, size_t to,
+                          size_t *out, size_t max) {
+  return scan_newlines_scalar(data, from, to, out, max);
+}
+
+size_t scan_newlines_avx2(const char *data, size_t from, size_t to,
+                          size_t *out, size_t max) {
+  return scan_newlines_scalar(data, from, to, out, max);
+}
+
+const char *scan_substr_sse2(const char *hay, size_t n, const char *needle,
+                             size_t k) {
+  return scan_substr_scalar(hay, n, needle, k);
+}
+
+const char *scan_substr_avx2(const char *hay, size_t n, const char *needle,
+                             size_t k) {
+  return scan_substr_scalar(hay, n, needle, k);
+}
+
+void scan_init() {}
+
+#endif
+
+const char *scan_name() {
+  if (scan_newlines == scan_newlines_avx2)
+    return "avx2";
+  if (scan_newlines == scan_newlines_sse2)
+    return "sse2";
+  return "scalar";
+}
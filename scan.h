@@ -0,0 +1,38 @@
+#ifndef SCAN_H_
+#define SCAN_H_
+
+#include <stddef.h>
+
+// Stores the offsets of up to `max` newlines in data[from, to) into `out` and
+// returns how many were found. A return value of `max` means the scan stopped
+// early at out[max - 1]; otherwise the whole range was scanned.
+typedef size_t (*scan_fn)(const char *data, size_t from, size_t to,
+                          size_t *out, size_t max);
+
+extern scan_fn scan_newlines;
+
+// Returns the first occurrence of needle[0, k) in hay[0, n), or NULL.
+typedef const char *(*substr_fn)(const char *hay, size_t n, const char *needle,
+                                 size_t k);
+
+extern substr_fn scan_substr;
+
+void scan_init();
+
+size_t scan_newlines_scalar(const char *data, size_t from, size_t to,
+                            size_t *out, size_t max);
+size_t scan_newlines_sse2(const char *data, size_t from, size_t to,
+                          size_t *out, size_t max);
+size_t scan_newlines_avx2(const char *data, size_t from, size_t to,
+                          size_t *out, size_t max);
+
+const char *scan_substr_scalar(const char *hay, size_t n, const char *needle,
+                               size_t k);
+const char *scan_substr_sse2(const char *hay, size_t n, const char *needle,
+                             size_t k);
+const char *scan_substr_avx2(const char *hay, size_t n, const char *needle,
+                             size_t k);
+
+const char *scan_name();
+
+#endif // SCAN_H_
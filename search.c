@@ -0,0 +1,456 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include "search.h"
+#include "common.h"
+#include "filter.h"
+#include "loggy.h"
+#include "matchlist.h"
+#include "merge.h"
+#include "scan.h"
+#include <limits.h>
+#include <pthread.h>
+#include <regex.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Rows per unit of work handed to the search workers. Ranges shorter than
+// this, such as rows appended in follow mode, are searched inline.
+#define SEARCH_CHUNK 16384
+
+struct SearchWorker {
+  Loggy *l;
+  pthread_t thread;
+  // Each worker compiles its own copy of the pattern, since matchers keep
+  // scratch state between calls.
+  Matcher matcher;
+  int generation;
+};
+
+// Collects the matches of the pattern in rows [from, to) into out, or just
+// counts them in count-only mode. Rows that do not contain the pattern's
+// required literal are skipped without running the matcher at all.
+static void find_rows(Loggy *l, Matcher *matcher, int from, int to,
+                      MatchList *out) {
+  const char *literal = l->matches.literal;
+  size_t literallen = l->matches.literallen;
+
+  for (int i = from; i < to; i++) {
+    char *cur_line = row_data(l, i);
+    regoff_t len = l->rows[i].len;
+    if (literallen > 0 && !scan_substr(cur_line, len, literal, literallen))
+      continue;
+
+    regoff_t off = 0;
+    regmatch_t match;
+    while (off <= len && matcher_exec(matcher, cur_line, len, off, &match)) {
+      matchlist_add(out, i, match.rm_so, !l->matches.count_only);
+      off = match.rm_eo > match.rm_so ? match.rm_eo : match.rm_eo + 1;
+    }
+  }
+}
+
+static void *search_worker(void *arg) {
+  SearchWorker *w = arg;
+  SearchPool *pool = &w->l->pool;
+
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (pool->next >= pool->nchunks)
+      pthread_cond_wait(&pool->wake, &pool->lock);
+
+    int c = pool->next++;
+    int generation = pool->generation;
+    const char *pattern = w->l->matches.pattern;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (w->generation != generation) {
+      if (w->generation != 0) {
+        matcher_free(&w->matcher);
+      }
+      // The pattern already compiled on the main thread, so this cannot fail.
+      matcher_compile(&w->matcher, pattern, w->l->c.matcher);
+      w->generation = generation;
+    }
+
+    int from = pool->from + c * SEARCH_CHUNK;
+    int to = from + SEARCH_CHUNK < pool->to ? from + SEARCH_CHUNK : pool->to;
+    find_rows(w->l, &w->matcher, from, to, &pool->results[c]);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->remaining == 0) {
+      pthread_cond_signal(&pool->idle);
+    }
+  }
+  return NULL;
+}
+
+void search_pool_start(Loggy *l) {
+  SearchPool *pool = &l->pool;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->wake, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+  pool->generation = 0;
+  pool->next = pool->nchunks = 0;
+
+  long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  pool->nworkers = ncpus > 1 ? ncpus : 1;
+  pool->workers = calloc(pool->nworkers, sizeof(SearchWorker));
+  if (pool->workers == NULL) {
+    die("calloc");
+  }
+  for (int i = 0; i < pool->nworkers; i++) {
+    pool->workers[i].l = l;
+    if (pthread_create(&pool->workers[i].thread, NULL, search_worker,
+                       &pool->workers[i]) != 0) {
+      die("pthread_create");
+    }
+  }
+}
+
+// Compressed rows are inflated into buffers only the main thread may use, so
+// those are searched on it rather than by the pool.
+static bool inline_only(Loggy *l) { return l->pool.nworkers == 0 || l->gz; }
+
+// Appends the matches in rows [from, to) to out. Large ranges are split
+// into chunks searched by the worker pool; per-chunk results are
+// concatenated in chunk order, so matches stay sorted by row.
+static void find(Loggy *l, int from, int to, MatchList *out) {
+  SearchPool *pool = &l->pool;
+
+  if (to - from <= SEARCH_CHUNK || inline_only(l)) {
+    find_rows(l, &l->matches.matcher, from, to, out);
+    return;
+  }
+
+  int nchunks = (to - from + SEARCH_CHUNK - 1) / SEARCH_CHUNK;
+  MatchList *results = calloc(nchunks, sizeof(MatchList));
+  if (results == NULL) {
+    die("calloc");
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->from = from;
+  pool->to = to;
+  pool->results = results;
+  pool->remaining = nchunks;
+  pool->next = 0;
+  pool->nchunks = nchunks;
+  pthread_cond_broadcast(&pool->wake);
+  while (pool->remaining > 0)
+    pthread_cond_wait(&pool->idle, &pool->lock);
+  pool->next = pool->nchunks = 0;
+  pthread_mutex_unlock(&pool->lock);
+
+  for (int c = 0; c < nchunks; c++) {
+    matchlist_concat(out, &results[c]);
+    matchlist_free(&results[c]);
+  }
+  free(results);
+}
+
+// Finds the longest run of plain characters that every match of the basic
+// regular expression pattern must contain, and stores it in out. Anything
+// that is not obviously literal ends the current run; alternation anywhere
+// means there is no single required literal. Returns its length.
+static size_t required_literal(const char *pattern, char *out) {
+  char cur[strlen(pattern) + 1];
+  size_t curlen = 0, bestlen = 0;
+  int depth = 0;
+
+#define FLUSH()                                                                \
+  do {                                                                         \
+    if (curlen > bestlen) {                                                    \
+      memcpy(out, cur, curlen);                                                \
+      bestlen = curlen;                                                        \
+    }                                                                          \
+    curlen = 0;                                                                \
+  } while (0)
+
+  for (const char *p = pattern; *p; p++) {
+    switch (*p) {
+    case '\\':
+      p++;
+      switch (*p) {
+      case '\0':
+        p--;
+        FLUSH();
+        break;
+      case '|':
+        return 0;
+      case '(':
+        FLUSH();
+        depth++;
+        break;
+      case ')':
+        FLUSH();
+        depth--;
+        break;
+      case '{':
+        // Skip the bounds, they are not part of the text.
+        while (p[1] && !(p[1] == '\\' && p[2] == '}'))
+          p++;
+        if (p[1])
+          p += 2;
+        // fallthrough
+      case '?':
+        // The quantified atom may be absent.
+        if (curlen > 0)
+          curlen--;
+        FLUSH();
+        break;
+      case '+':
+        FLUSH();
+        break;
+      case '.':
+      case '*':
+      case '[':
+      case ']':
+      case '^':
+      case '$':
+      case '\\':
+      case '/':
+        if (depth == 0) {
+          cur[curlen++] = *p;
+        } else {
+          FLUSH();
+        }
+        break;
+      default:
+        // \w, \<, back-references and other GNU escapes.
+        FLUSH();
+        break;
+      }
+      break;
+    case '*':
+      if (curlen > 0)
+        curlen--;
+      FLUSH();
+      break;
+    case '[':
+      FLUSH();
+      p++;
+      if (*p == '^')
+        p++;
+      if (*p == ']')
+        p++;
+      while (*p && *p != ']') {
+        if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+          char close = p[1];
+          p += 2;
+          while (*p && !(*p == close && p[1] == ']'))
+            p++;
+          if (*p)
+            p++;
+        }
+        if (*p)
+          p++;
+      }
+      if (*p == '\0')
+        p--;
+      break;
+    case '.':
+    case '^':
+    case '$':
+      FLUSH();
+      break;
+    default:
+      if (depth == 0) {
+        cur[curlen++] = *p;
+      } else {
+        FLUSH();
+      }
+      break;
+    }
+  }
+  FLUSH();
+
+#undef FLUSH
+
+  return bestlen;
+}
+
+// Starts a search for pattern. The search itself runs in bounded steps from
+// the main loop, see search_step. Repeating the current search keeps the
+// compiled pattern and the matches found so far. Returns false if the pattern
+// does not compile.
+bool search_start(Loggy *l, const char *pattern) {
+  Matches *m = &l->matches;
+
+  if (m->pattern && strcmp(m->pattern, pattern) == 0)
+    return true;
+
+  Matcher matcher;
+  if (!matcher_compile(&matcher, pattern, l->c.matcher))
+    return false;
+
+  search_stop(l);
+  // Matches are counted and jumped between across every row.
+  merge_want(l, INT_MAX);
+  m->pattern = strdup(pattern);
+  m->matcher = matcher;
+  m->literal = malloc(strlen(pattern) + 1);
+  m->literallen = required_literal(pattern, m->literal);
+
+  pthread_mutex_lock(&l->pool.lock);
+  l->pool.generation++;
+  pthread_mutex_unlock(&l->pool.lock);
+
+  // Search from the top of the viewport down first, so what is on screen
+  // and just below the cursor is covered within the first step.
+  search_reset(l);
+  m->start = l->rowoff < l->nrows ? l->rowoff : l->nrows;
+  m->scanned = m->start;
+  return true;
+}
+
+// Forgets the current pattern and its results.
+void search_stop(Loggy *l) {
+  Matches *m = &l->matches;
+  if (m->pattern == NULL)
+    return;
+
+  search_reset(l);
+  matcher_free(&m->matcher);
+  free(m->pattern);
+  free(m->literal);
+  m->pattern = NULL;
+  m->literal = NULL;
+  m->literallen = 0;
+}
+
+bool search_busy(Loggy *l) {
+  Matches *m = &l->matches;
+  return m->pattern && (m->scanned < l->nrows || m->wrapped < m->start);
+}
+
+// Moves the cursor to the first match at or after where it was when the
+// pattern was typed, or the last one before it going backward, once such a
+// match is known.
+static bool preview_jump(Loggy *l) {
+  Matches *m = &l->matches;
+  if (!m->preview || m->jumped || m->list.len == 0)
+    return false;
+
+  int i = matchlist_find(&m->list, m->origin_cy, m->origin_cx);
+  if (m->backward) {
+    // Matches above the origin are only certain once its row is searched,
+    // and there may be none until the rows above the start are too.
+    if ((i == 0 || m->scanned <= m->origin_cy) && search_busy(l))
+      return false;
+    i = (i > 0 ? i : m->list.len) - 1;
+  } else if (i == m->list.len) {
+    // Nothing after the origin; wrap around once every row has been seen.
+    if (search_busy(l))
+      return false;
+    i = 0;
+  }
+
+  MatchCursor c;
+  int row, col;
+  matchlist_seek(&m->list, i, &c);
+  matchlist_next(&c, &row, &col);
+  l->cy = view_find(l, row);
+  l->cx = col;
+  m->jumped = true;
+  return true;
+}
+
+// Searches the next slice of rows: first forward from where the search
+// started, including rows appended since, then the rows above it. Each call
+// does a bounded amount of work so a new key can cancel the search by
+// replacing the pattern. Returns true if the cursor moved or the search
+// finished.
+bool search_step(Loggy *l) {
+  Matches *m = &l->matches;
+  if (!search_busy(l))
+    return false;
+
+  // A step searched inline holds up the keys, so it does not grow with the
+  // number of workers.
+  int budget =
+      inline_only(l) ? SEARCH_CHUNK : SEARCH_CHUNK * 2 * l->pool.nworkers;
+  if (m->scanned < l->nrows) {
+    int to = m->scanned + budget < l->nrows ? m->scanned + budget : l->nrows;
+    find(l, m->scanned, to, &m->list);
+    m->scanned = to;
+  } else {
+    int to = m->wrapped + budget < m->start ? m->wrapped + budget : m->start;
+    find(l, m->wrapped, to, &m->wrap);
+    m->wrapped = to;
+
+    if (m->wrapped == m->start) {
+      // Put the rows above the starting point in front, keeping the whole
+      // list sorted by row.
+      matchlist_concat(&m->wrap, &m->list);
+      matchlist_free(&m->list);
+      m->list = m->wrap;
+      m->wrap = (MatchList){0};
+      m->start = m->wrapped = 0;
+      m->version++;
+    }
+  }
+
+  bool moved = preview_jump(l);
+  return moved || !search_busy(l);
+}
+
+// Forgets matches at or after row, which is about to be re-indexed. Counts
+// cannot be taken apart by row, so in count-only mode everything is counted
+// again.
+void search_truncate(Loggy *l, int row) {
+  Matches *m = &l->matches;
+  m->version++;
+  if (m->count_only) {
+    matchlist_clear(&m->list);
+    matchlist_clear(&m->wrap);
+    m->start = m->scanned = m->wrapped = 0;
+    return;
+  }
+
+  matchlist_truncate(&m->list, row);
+  if (m->scanned > row)
+    m->scanned = row;
+
+  if (row < m->start) {
+    matchlist_truncate(&m->wrap, row);
+    if (m->wrapped > row)
+      m->wrapped = row;
+    m->start = row;
+  }
+}
+
+// Forgets matches in the first n rows, which are being evicted, and moves
+// everything else up by n rows.
+void search_evict(Loggy *l, int n) {
+  Matches *m = &l->matches;
+  m->origin_cy = m->origin_cy > n ? m->origin_cy - n : 0;
+  if (m->count_only) {
+    search_reset(l);
+    return;
+  }
+
+  matchlist_evict(&m->list, n);
+  matchlist_evict(&m->wrap, n);
+  m->version++;
+
+  m->start = m->start > n ? m->start - n : 0;
+  m->scanned = m->scanned > n ? m->scanned - n : 0;
+  m->wrapped = m->wrapped > n ? m->wrapped - n : 0;
+}
+
+// Switches between keeping every match and only counting them, and runs the
+// search again from the top.
+void search_toggle_count(Loggy *l) {
+  Matches *m = &l->matches;
+  matchlist_free(&m->list);
+  matchlist_free(&m->wrap);
+  m->count_only = !m->count_only;
+  m->start = m->scanned = m->wrapped = 0;
+  m->version++;
+}
+
+// Drops all results but keeps the compiled pattern, so the search runs again
+// over whatever rows get loaded next.
+void search_reset(Loggy *l) { search_truncate(l, 0); }
@@ -0,0 +1,16 @@
+#ifndef SEARCH_H_
+#define SEARCH_H_
+
+#include "loggy.h"
+
+void search_pool_start(Loggy *l);
+bool search_start(Loggy *l, const char *pattern);
+void search_stop(Loggy *l);
+bool search_busy(Loggy *l);
+bool search_step(Loggy *l);
+void search_truncate(Loggy *l, int row);
+void search_evict(Loggy *l, int n);
+void search_reset(Loggy *l);
+void search_toggle_count(Loggy *l);
+
+#endif // SEARCH_H_
@@ -0,0 +1,101 @@
+#include "stream.h"
+#include "common.h"
+#include "filter.h"
+#include "loggy.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Most bytes taken from the pipe per call, so a fast writer cannot keep the
+// main loop from handling keys.
+#define STREAM_BUDGET (4 << 20)
+
+// Reads log data from a pipe, such as stdin, as it arrives. Lines go into
+// the arena like any unmappable input; once the arena holds more than
+// l->c.stream_buffer bytes its oldest chunk and the rows in it are evicted.
+void stream_start(Loggy *l, int fd) {
+  Stream *s = &l->stream;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  *s = (Stream){.enabled = true, .fd = fd, .partial = {0}};
+}
+
+void stream_stop(Loggy *l) {
+  Stream *s = &l->stream;
+  if (s->fd == -1)
+    return;
+  close(s->fd);
+  free(s->partial.data);
+  s->partial = (Buffer){0};
+  s->fd = -1;
+}
+
+static void append_line(Loggy *l, const char *line, size_t len) {
+  while (len > 0 && line[len - 1] == '\r')
+    len--;
+  row_append(l, (char *)line, len);
+}
+
+// Evicts whole arena chunks, oldest first, until the cap is met again.
+static void evict(Loggy *l) {
+  Arena *a = &l->arena;
+  while (a->bytes > l->c.stream_buffer && a->nchunks > 1) {
+    int n = 0;
+    while (n < l->nrows && (int)(l->rows[n].off >> 32) == a->first)
+      n++;
+    rows_evict(l, n);
+    arena_evict(a);
+  }
+}
+
+// Takes whatever the pipe has to offer. Returns true if rows were added.
+bool stream_poll(Loggy *l) {
+  Stream *s = &l->stream;
+  if (s->fd == -1)
+    return false;
+
+  // Like follow mode, stay on the last row while it is being written to.
+  int len = view_len(l);
+  bool stick = len == 0 || l->cy >= len - 1;
+  int nrows = l->nrows;
+
+  char buf[1 << 16];
+  size_t total = 0;
+  while (total < STREAM_BUDGET) {
+    ssize_t n = read(s->fd, buf, sizeof(buf));
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1 && errno == EAGAIN)
+      break;
+    if (n <= 0) {
+      // End of input; keep a last line that had no newline.
+      if (s->partial.len > 0)
+        append_line(l, s->partial.data, s->partial.len);
+      stream_stop(l);
+      break;
+    }
+    total += n;
+
+    char *p = buf, *end = buf + n;
+    char *nl;
+    while ((nl = memchr(p, '\n', end - p)) != NULL) {
+      if (s->partial.len > 0) {
+        buf_append(&s->partial, p, nl - p);
+        append_line(l, s->partial.data, s->partial.len);
+        s->partial.len = 0;
+      } else {
+        append_line(l, p, nl - p);
+      }
+      p = nl + 1;
+    }
+    buf_append(&s->partial, p, end - p);
+    evict(l);
+  }
+
+  if (l->nrows == nrows)
+    return false;
+  if (stick && view_len(l) > 0)
+    l->cy = view_len(l) - 1;
+  return true;
+}
@@ -0,0 +1,10 @@
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include "loggy.h"
+
+void stream_start(Loggy *l, int fd);
+bool stream_poll(Loggy *l);
+void stream_stop(Loggy *l);
+
+#endif // STREAM_H_
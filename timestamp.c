@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+
+#include "timestamp.h"
+#include "filter.h"
+#include "loggy.h"
+#include "merge.h"
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Formats tried, in order, when config.json does not list any. A row matches
+// a format on any prefix, so longer formats come first.
+static const char *default_formats[] = {
+    "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M:%S", "%Y/%m/%d %H:%M:%S",
+    "%d/%b/%Y:%H:%M:%S", "%b %d %H:%M:%S",    "%Y-%m-%d",
+    "%H:%M:%S",          "%H:%M",
+};
+
+// Only this much of a row is read; timestamps sit at the start of the line.
+#define PREFIX_MAX 64
+// Rows without a timestamp, like the lines of a stack trace, are stepped
+// over. Past this many in a row the bisection gives up on that half.
+#define SKIP_MAX 4096
+#define UNSET INT_MIN
+
+// Year, month, day, hour, minute and second, most significant first.
+typedef struct {
+  int f[6];
+} Time;
+
+// Parses a timestamp at the start of s, after any leading punctuation such
+// as the '[' in "[2024-01-02 ...". Fields the format lacks are left UNSET.
+// If whole is set, nothing but spaces may follow the timestamp; otherwise
+// rest, if given, is set to what follows it.
+static bool parse(Loggy *l, const char *s, bool whole, Time *t,
+                  const char **rest) {
+  const char **formats = (const char **)l->c.time_formats;
+  int nformats = l->c.ntime_formats;
+  if (nformats == 0) {
+    formats = default_formats;
+    nformats = sizeof(default_formats) / sizeof(*default_formats);
+  }
+
+  while (*s && !isalnum((unsigned char)*s))
+    s++;
+  for (int i = 0; i < nformats; i++) {
+    struct tm tm = {.tm_year = UNSET,
+                    .tm_mon = UNSET,
+                    .tm_mday = UNSET,
+                    .tm_hour = UNSET,
+                    .tm_min = UNSET,
+                    .tm_sec = UNSET};
+    const char *end = strptime(s, formats[i], &tm);
+    if (end == NULL)
+      continue;
+    if (whole) {
+      while (isspace((unsigned char)*end))
+        end++;
+      if (*end != '\0')
+        continue;
+    }
+    *t = (Time){{tm.tm_year, tm.tm_mon, tm.tm_mday, tm.tm_hour, tm.tm_min,
+                 tm.tm_sec}};
+    if (rest)
+      *rest = end;
+    return true;
+  }
+  return false;
+}
+
+// Fields the time lacks count as zero.
+static TimeKey key_of(const Time *t, long nsec) {
+  long long sec = 0;
+  // Not real calendar arithmetic, but it orders the same way.
+  static const int scale[6] = {12, 31, 24, 60, 60, 1};
+  for (int i = 0; i < 6; i++)
+    sec = (sec + (t->f[i] == UNSET ? 0 : t->f[i])) * scale[i];
+  return (TimeKey){sec, nsec};
+}
+
+// Reads the timestamp at the start of the len bytes at s as a key that
+// orders rows by time, including any fraction of a second after it. Fields
+// the format lacks count as zero. Returns false if there is no timestamp.
+bool timestamp_key(Loggy *l, const char *s, int len, TimeKey *key) {
+  char prefix[PREFIX_MAX + 1];
+  if (len > PREFIX_MAX)
+    len = PREFIX_MAX;
+  memcpy(prefix, s, len);
+  prefix[len] = '\0';
+
+  Time t;
+  const char *rest;
+  if (!parse(l, prefix, false, &t, &rest))
+    return false;
+
+  long nsec = 0;
+  if ((*rest == '.' || *rest == ',') && isdigit((unsigned char)rest[1])) {
+    int digits = 0;
+    for (rest++; isdigit((unsigned char)*rest) && digits < 9; rest++, digits++)
+      nsec = nsec * 10 + (*rest - '0');
+    for (; digits < 9; digits++)
+      nsec *= 10;
+  }
+  *key = key_of(&t, nsec);
+  return true;
+}
+
+// Compares only the fields both times have, so a syslog row without a year
+// still orders against a full date.
+static int compare(const Time *a, const Time *b) {
+  for (int i = 0; i < 6; i++) {
+    if (a->f[i] == UNSET || b->f[i] == UNSET)
+      continue;
+    if (a->f[i] != b->f[i])
+      return a->f[i] < b->f[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+// Returns the first view position in [from, to) whose row has a timestamp,
+// looking at most SKIP_MAX rows ahead, or to if there is none.
+static int next_stamped(Loggy *l, int from, int to, Time *t) {
+  char prefix[PREFIX_MAX + 1];
+  int limit = to - from > SKIP_MAX ? from + SKIP_MAX : to;
+  for (int i = from; i < limit; i++) {
+    int row = view_row(l, i);
+    int len = l->rows[row].len < PREFIX_MAX ? l->rows[row].len : PREFIX_MAX;
+    memcpy(prefix, row_data(l, row), len);
+    prefix[len] = '\0';
+    if (parse(l, prefix, false, t, NULL))
+      return i;
+  }
+  return to;
+}
+
+// Moves the cursor to the first row at or after when, bisecting the view so
+// only O(log n) rows are parsed. Returns false if when is not a time.
+bool goto_time(Loggy *l, const char *when) {
+  Time target;
+  if (!parse(l, when, true, &target, NULL))
+    return false;
+
+  int len = view_len(l);
+  if (len == 0)
+    return true;
+
+  // A time without a date means that time on the day being looked at.
+  Time here;
+  if (next_stamped(l, l->cy, len, &here) < len) {
+    for (int i = 0; i < 3; i++) {
+      if (target.f[i] == UNSET)
+        target.f[i] = here.f[i];
+    }
+  }
+
+  // Merged rows come in time order, so the merge only has to get as far as
+  // the target. Until it has, the jump waits for it, see goto_time_poll.
+  free(l->pending_time);
+  l->pending_time = NULL;
+  if (!merge_reached(l, key_of(&target, 0))) {
+    merge_want_time(l, key_of(&target, 0));
+    l->pending_time = strdup(when);
+    write_status_message(l, "Merging up to %s...", when);
+    return true;
+  }
+
+  int left = 0;
+  int right = len;
+  while (left < right) {
+    int middle = left + (right - left) / 2;
+    Time t;
+    int found = next_stamped(l, middle, right, &t);
+    if (found < right && compare(&t, &target) < 0) {
+      left = found + 1;
+    } else {
+      right = middle;
+    }
+  }
+
+  Time t;
+  int found = next_stamped(l, left, len, &t);
+  if (found == len) {
+    write_status_message(l, "No lines at or after %s", when);
+    found = len - 1;
+  }
+  l->cy = found;
+  l->cx = 0;
+  return true;
+}
+
+// Makes the jump goto_time left waiting once the merge has reached it.
+// Returns true if the cursor moved.
+bool goto_time_poll(Loggy *l) {
+  char *when = l->pending_time;
+  // Any key drops the jump, so it only ever waits in normal mode, where the
+  // status line holds its message rather than a prompt.
+  if (when == NULL || l->mode != NORMAL || merge_busy(l))
+    return false;
+  // goto_time leaves it waiting again if the merge is still short of it.
+  l->pending_time = NULL;
+  clear_status_message(l);
+  goto_time(l, when);
+  free(when);
+  return l->pending_time == NULL;
+}
+
+// Drops the jump goto_time left waiting, if there is one. Returns true if
+// there was.
+bool goto_time_cancel(Loggy *l) {
+  if (l->pending_time == NULL)
+    return false;
+  free(l->pending_time);
+  l->pending_time = NULL;
+  clear_status_message(l);
+  return true;
+}
@@ -0,0 +1,17 @@
+#ifndef TIMESTAMP_H_
+#define TIMESTAMP_H_
+
+#include "loggy.h"
+
+// A row's timestamp as a single value, for ordering rows of different files.
+typedef struct {
+  long long sec;
+  long nsec;
+} TimeKey;
+
+bool goto_time(Loggy *l, const char *when);
+bool goto_time_poll(Loggy *l);
+bool goto_time_cancel(Loggy *l);
+bool timestamp_key(Loggy *l, const char *s, int len, TimeKey *key);
+
+#endif // TIMESTAMP_H_